@@ -2,21 +2,75 @@
 #include <vector>
 #include <memory>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <map>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <deque>
+#include <variant>
+#include <charconv>
+#include <iterator>
+#include <type_traits>
+#include <limits>
+#include <array>
+#include <ctime>
+#include <atomic>
+#include <random>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <csignal>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ACS_HAVE_SSE2 1
+#endif
+
+enum class UserType : uint8_t {
+    Student,
+    Teacher,
+    Administrator
+};
 
 class User {
 protected:
     std::string name;
     int id;
     int accessLevel;
+    uint32_t permissionMask = 0; // grant bits derived by the owning AccessControlSystem, not persisted
 
 public:
-    User(const std::string& name, int id, int accessLevel)
-        : name(name), id(id), accessLevel(accessLevel) {
-        if (name.empty()) {
+    User(std::string name, int id, int accessLevel)
+        : name(std::move(name)), id(id), accessLevel(accessLevel) {
+        if (this->name.empty()) {
             throw std::invalid_argument("User name cannot be empty");
         }
         if (accessLevel < 0) {
@@ -26,9 +80,13 @@ public:
 
     virtual ~User() {}
 
+    virtual UserType getType() const = 0;
+
     std::string getName() const { return name; }
     int getId() const { return id; }
     int getAccessLevel() const { return accessLevel; }
+    uint32_t getPermissionMask() const { return permissionMask; }
+    void setPermissionMask(uint32_t mask) { permissionMask = mask; }
 
     void setName(const std::string& newName) {
         if (newName.empty()) {
@@ -60,14 +118,14 @@ public:
     }
 };
 
-class Student : public User {
+class Student final : public User {
 private:
     std::string group;
 
 public:
-    Student(const std::string& name, int id, int accessLevel, const std::string& group)
-        : User(name, id, accessLevel), group(group) {
-        if (group.empty()) {
+    Student(std::string name, int id, int accessLevel, std::string group)
+        : User(std::move(name), id, accessLevel), group(std::move(group)) {
+        if (this->group.empty()) {
             throw std::invalid_argument("Group cannot be empty");
         }
     }
@@ -80,6 +138,8 @@ public:
         group = newGroup;
     }
 
+    UserType getType() const override { return UserType::Student; }
+
     void displayInfo() const override {
         User::displayInfo();
         std::cout << ", Type: Student, Group: " << group << std::endl;
@@ -97,14 +157,14 @@ public:
     }
 };
 
-class Teacher : public User {
+class Teacher final : public User {
 private:
     std::string department;
 
 public:
-    Teacher(const std::string& name, int id, int accessLevel, const std::string& department)
-        : User(name, id, accessLevel), department(department) {
-        if (department.empty()) {
+    Teacher(std::string name, int id, int accessLevel, std::string department)
+        : User(std::move(name), id, accessLevel), department(std::move(department)) {
+        if (this->department.empty()) {
             throw std::invalid_argument("Department cannot be empty");
         }
     }
@@ -117,6 +177,8 @@ public:
         department = newDepartment;
     }
 
+    UserType getType() const override { return UserType::Teacher; }
+
     void displayInfo() const override {
         User::displayInfo();
         std::cout << ", Type: Teacher, Department: " << department << std::endl;
@@ -134,14 +196,14 @@ public:
     }
 };
 
-class Administrator : public User {
+class Administrator final : public User {
 private:
     std::string position;
 
 public:
-    Administrator(const std::string& name, int id, int accessLevel, const std::string& position)
-        : User(name, id, accessLevel), position(position) {
-        if (position.empty()) {
+    Administrator(std::string name, int id, int accessLevel, std::string position)
+        : User(std::move(name), id, accessLevel), position(std::move(position)) {
+        if (this->position.empty()) {
             throw std::invalid_argument("Position cannot be empty");
         }
     }
@@ -154,6 +216,8 @@ public:
         position = newPosition;
     }
 
+    UserType getType() const override { return UserType::Administrator; }
+
     void displayInfo() const override {
         User::displayInfo();
         std::cout << ", Type: Administrator, Position: " << position << std::endl;
@@ -171,30 +235,303 @@ public:
     }
 };
 
+const char* userTypeName(UserType type) {
+    switch (type) {
+    case UserType::Student: return "Student";
+    case UserType::Teacher: return "Teacher";
+    case UserType::Administrator: return "Administrator";
+    }
+    return "Unknown";
+}
+
+bool parseUserType(std::string_view name, UserType& type) {
+    for (UserType candidate : { UserType::Student, UserType::Teacher, UserType::Administrator }) {
+        if (name == userTypeName(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Group, department or position, depending on the user type
+std::string userAttribute(const User& user) {
+    switch (user.getType()) {
+    case UserType::Student: return static_cast<const Student&>(user).getGroup();
+    case UserType::Teacher: return static_cast<const Teacher&>(user).getDepartment();
+    case UserType::Administrator: return static_cast<const Administrator&>(user).getPosition();
+    }
+    return std::string();
+}
+
+std::unique_ptr<User> makeUser(UserType type, std::string name, int id, int accessLevel, std::string attribute) {
+    switch (type) {
+    case UserType::Student: return std::make_unique<Student>(std::move(name), id, accessLevel, std::move(attribute));
+    case UserType::Teacher: return std::make_unique<Teacher>(std::move(name), id, accessLevel, std::move(attribute));
+    case UserType::Administrator: return std::make_unique<Administrator>(std::move(name), id, accessLevel, std::move(attribute));
+    }
+    throw std::invalid_argument("Unknown user type");
+}
+
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatHashMap {
+private:
+    struct Slot {
+        Key key;
+        Value value;
+        bool used = false;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+    unsigned shift = 64;
+
+    template<typename K>
+    size_t slotFor(const K& key) const {
+        // Fibonacci hashing spreads identity hashes (e.g. std::hash<int>) over the table
+        return static_cast<size_t>((static_cast<uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void rehash(size_t newCapacity) {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(newCapacity, Slot{});
+        shift = 64;
+        for (size_t c = newCapacity; c > 1; c >>= 1) {
+            --shift;
+        }
+        count = 0;
+        for (auto& slot : old) {
+            if (slot.used) {
+                insert(slot.key, slot.value);
+            }
+        }
+    }
+
+public:
+    void clear() {
+        slots.clear();
+        count = 0;
+        shift = 64;
+    }
+
+    void reserve(size_t n) {
+        size_t capacity = 8;
+        while (capacity < n * 2) {
+            capacity <<= 1;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    size_t size() const { return count; }
+
+    // Returns false (and leaves the map unchanged) if the key is already present
+    bool insert(const Key& key, const Value& value) {
+        if ((count + 1) * 2 > slots.size()) {
+            reserve(count + 1);
+        }
+        const size_t mask = slots.size() - 1;
+        for (size_t i = slotFor(key);; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (!slot.used) {
+                slot.key = key;
+                slot.value = value;
+                slot.used = true;
+                ++count;
+                return true;
+            }
+            if (slot.key == key) {
+                return false;
+            }
+        }
+    }
+
+    // K may be any type that Hash accepts and that compares with Key (e.g. string_view for string keys)
+    template<typename K>
+    const Value* find(const K& key) const {
+        if (count == 0) {
+            return nullptr;
+        }
+        const size_t mask = slots.size() - 1;
+        for (size_t i = slotFor(key);; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (!slot.used) {
+                return nullptr;
+            }
+            if (slot.key == key) {
+                return &slot.value;
+            }
+        }
+    }
+};
+
+// Process-wide interner for resource names: each distinct name gets a dense handle once, and its text
+// lives at a stable address for the rest of the process, so resources share it instead of copying it
+class ResourceNames {
+private:
+    std::deque<std::string> arena;
+    FlatHashMap<std::string, uint32_t, std::hash<std::string_view>> handles;
+    mutable std::mutex mutex;
+
+    ResourceNames() {}
+
+public:
+    static ResourceNames& instance() {
+        static ResourceNames names;
+        return names;
+    }
+
+    uint32_t intern(std::string_view name, const std::string** text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (const uint32_t* handle = handles.find(name)) {
+            *text = &arena[*handle];
+            return *handle;
+        }
+        uint32_t handle = static_cast<uint32_t>(arena.size());
+        arena.emplace_back(name);
+        handles.insert(arena.back(), handle);
+        *text = &arena.back();
+        return handle;
+    }
+
+    // Returns -1 for a name that was never interned
+    int find(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const uint32_t* handle = handles.find(name);
+        return handle ? static_cast<int>(*handle) : -1;
+    }
+
+    // Empty for an unknown handle
+    std::string name(uint32_t handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return handle < arena.size() ? arena[handle] : std::string();
+    }
+};
+
+enum class PermissionKind : uint8_t {
+    Group,
+    Department,
+    Position
+};
+
+// The attribute each user type carries: a student's group, a teacher's department, an administrator's position
+PermissionKind permissionKindOf(UserType type) {
+    switch (type) {
+    case UserType::Student: return PermissionKind::Group;
+    case UserType::Teacher: return PermissionKind::Department;
+    case UserType::Administrator: return PermissionKind::Position;
+    }
+    return PermissionKind::Group;
+}
+
+// Assigns one bit of a 32-bit grant mask to each (kind, value) attribute that some resource grants access to
+class PermissionRegistry {
+private:
+    FlatHashMap<std::string, uint32_t, std::hash<std::string_view>> bits;
+    std::vector<std::string> attributes; // attributes[i] holds bit 1 << i
+
+    static std::string key(PermissionKind kind, std::string_view value) {
+        std::string result(1, static_cast<char>('0' + static_cast<int>(kind)));
+        result += value;
+        return result;
+    }
+
+public:
+    static const uint32_t kMaxGrants = 32;
+
+    // Returns the attribute's bit, allocating one if needed; allocated is set when a new bit was assigned
+    uint32_t bitFor(PermissionKind kind, std::string_view value, bool& allocated) {
+        std::string attribute = key(kind, value);
+        if (const uint32_t* bit = bits.find(attribute)) {
+            allocated = false;
+            return *bit;
+        }
+        if (attributes.size() == kMaxGrants) {
+            throw std::runtime_error("No more than 32 distinct grant attributes are supported");
+        }
+        uint32_t bit = uint32_t(1) << attributes.size();
+        bits.insert(attribute, bit);
+        attributes.push_back(std::move(attribute));
+        allocated = true;
+        return bit;
+    }
+
+    uint32_t maskFor(const User& user) const {
+        const uint32_t* bit = bits.find(key(permissionKindOf(user.getType()), userAttribute(user)));
+        return bit ? *bit : 0;
+    }
+
+    // Attributes in bit order, so a registry rebuilt by calling bitFor in this order assigns the same bits
+    size_t size() const { return attributes.size(); }
+    PermissionKind kindAt(size_t i) const { return static_cast<PermissionKind>(attributes[i][0] - '0'); }
+    std::string_view valueAt(size_t i) const { return std::string_view(attributes[i]).substr(1); }
+
+    void clear() {
+        bits.clear();
+        attributes.clear();
+    }
+};
+
 class Resource {
 private:
-    std::string name;
+    std::string_view name; // interned, or owned by the resource type's registry
+    uint32_t handle;
     int requiredAccessLevel;
+    uint32_t grantMask = 0; // users holding any of these bits get in regardless of level
+
+    void intern(std::string_view newName) {
+        const std::string* text;
+        handle = ResourceNames::instance().intern(newName, &text);
+        name = *text;
+    }
+
+protected:
+    // For resource types with a handle space of their own; name must outlive the resource
+    Resource(std::string_view name, uint32_t handle, int requiredAccessLevel)
+        : name(name), handle(handle), requiredAccessLevel(requiredAccessLevel) {
+        if (requiredAccessLevel < 0) {
+            throw std::invalid_argument("Required access level cannot be negative");
+        }
+    }
+
+    void rename(std::string_view newName, uint32_t newHandle) {
+        name = newName;
+        handle = newHandle;
+    }
 
 public:
-    Resource(const std::string& name, int requiredAccessLevel)
-        : name(name), requiredAccessLevel(requiredAccessLevel) {
+    // The handle of a resource with this name, -1 if no such resource was ever created
+    static int handleOf(std::string_view name) { return ResourceNames::instance().find(name); }
+    static std::string nameOf(uint32_t handle) { return ResourceNames::instance().name(handle); }
+
+    Resource(std::string_view name, int requiredAccessLevel)
+        : requiredAccessLevel(requiredAccessLevel) {
         if (name.empty()) {
             throw std::invalid_argument("Resource name cannot be empty");
         }
         if (requiredAccessLevel < 0) {
             throw std::invalid_argument("Required access level cannot be negative");
         }
+        intern(name);
     }
 
-    std::string getName() const { return name; }
+    virtual ~Resource() = default;
+    Resource(const Resource&) = default;
+    Resource& operator=(const Resource&) = default;
+
+    std::string_view getName() const { return name; }
+    uint32_t getHandle() const { return handle; }
     int getRequiredAccessLevel() const { return requiredAccessLevel; }
+    uint32_t getGrantMask() const { return grantMask; }
+    void addGrant(uint32_t bits) { grantMask |= bits; }
 
-    void setName(const std::string& newName) {
+    // Virtual so that resource types with their own handles keep them consistent with the name
+    virtual void setName(const std::string& newName) {
         if (newName.empty()) {
             throw std::invalid_argument("Resource name cannot be empty");
         }
-        name = newName;
+        intern(newName);
     }
 
     void setRequiredAccessLevel(int newLevel) {
@@ -204,195 +541,5074 @@ public:
         requiredAccessLevel = newLevel;
     }
 
+    // The level rule, or any grant bit in common; with no grants this is the plain level comparison
     bool checkAccess(const User& user) const {
-        return user.getAccessLevel() >= requiredAccessLevel;
+        return (user.getAccessLevel() >= requiredAccessLevel) | ((user.getPermissionMask() & grantMask) != 0);
     }
 
     void saveToFile(std::ofstream& out) const {
         out << name << '\n' << requiredAccessLevel << '\n';
     }
 
-    void loadFromFile(std::ifstream& in) {
-        std::getline(in, name);
+    virtual void loadFromFile(std::ifstream& in) {
+        std::string newName;
+        std::getline(in, newName);
+        intern(newName);
         in >> requiredAccessLevel;
         in.ignore();
     }
 };
 
-template<typename T>
-class AccessControlSystem {
-private:
-    std::vector<std::unique_ptr<User>> users;
-    std::vector<T> resources;
+struct FixedResourceSpec {
+    std::string_view name;
+    int requiredAccessLevel;
+};
 
+// Perfect hash over a resource list fixed at build time: the table and its seed are computed by the
+// compiler, so looking a name up is one hash, one table load and one comparison at run time
+template<size_t N>
+class PerfectHashRegistry {
 public:
-    template<typename U, typename... Args>
-    void addUser(Args&&... args) {
-        users.emplace_back(std::make_unique<U>(std::forward<Args>(args)...));
-    }
-
-    void addResource(const T& resource) {
-        resources.push_back(resource);
+    static constexpr unsigned bitsFor(size_t n) {
+        unsigned bits = 1;
+        while ((size_t(1) << bits) < 2 * n) {
+            ++bits;
+        }
+        return bits;
     }
 
-    std::string checkAccess(int userId, const std::string& resourceName) const {
-        auto userIt = std::find_if(users.begin(), users.end(),
-            [userId](const auto& user) { return user->getId() == userId; });
+    static constexpr unsigned kBits = bitsFor(N);
+    static constexpr size_t kSlots = size_t(1) << kBits;
 
-        auto resourceIt = std::find_if(resources.begin(), resources.end(),
-            [resourceName](const auto& resource) { return resource.getName() == resourceName; });
+private:
+    std::array<FixedResourceSpec, N> specs{};
+    std::array<int16_t, kSlots> slots{};
+    uint64_t seed = 0;
 
-        if (userIt == users.end()) {
-            throw std::runtime_error("User not found");
-        }
-        if (resourceIt == resources.end()) {
-            throw std::runtime_error("Resource not found");
+    static constexpr uint64_t nameHash(std::string_view name) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
         }
+        return hash;
+    }
 
-        bool accessGranted = resourceIt->checkAccess(**userIt);
-        return (**userIt).getName() + " is trying to access '" + resourceIt->getName() + "': " + (accessGranted ? "Access granted" : "Access denied");
+    static constexpr size_t slotOf(uint64_t hash, uint64_t seed) {
+        return static_cast<size_t>(((hash ^ seed) * 0x9E3779B97F4A7C15ull) >> (64 - kBits));
     }
 
-    std::vector<User*> findUsersByName(const std::string& name) const {
-        std::vector<User*> result;
-        for (const auto& user : users) {
-            if (user->getName() == name) {
-                result.push_back(user.get());
+public:
+    constexpr explicit PerfectHashRegistry(const FixedResourceSpec (&list)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                if (list[i].name == list[j].name) {
+                    throw std::invalid_argument("Duplicate resource name in registry");
+                }
+            }
+            specs[i] = list[i];
+        }
+        // At load factor <= 1/2 a collision-free seed turns up after a handful of tries
+        for (seed = 1;; ++seed) {
+            for (auto& slot : slots) {
+                slot = -1;
+            }
+            bool collision = false;
+            for (size_t i = 0; i < N && !collision; ++i) {
+                size_t slot = slotOf(nameHash(specs[i].name), seed);
+                collision = slots[slot] >= 0;
+                slots[slot] = static_cast<int16_t>(i);
+            }
+            if (!collision) {
+                break;
             }
         }
-        return result;
     }
 
-    User* findUserById(int id) const {
-        auto it = std::find_if(users.begin(), users.end(),
-            [id](const auto& user) { return user->getId() == id; });
-        return it != users.end() ? it->get() : nullptr;
-    }
+    constexpr size_t size() const { return N; }
+    constexpr const FixedResourceSpec& operator[](size_t index) const { return specs[index]; }
 
-    void sortUsersByAccessLevel() {
-        std::sort(users.begin(), users.end(),
-            [](const auto& a, const auto& b) {
-                return a->getAccessLevel() < b->getAccessLevel();
-            });
+    // Position in the list, -1 for a name that is not in it
+    constexpr int indexOf(std::string_view name) const {
+        int index = slots[slotOf(nameHash(name), seed)];
+        return index >= 0 && specs[index].name == name ? index : -1;
     }
 
-    void sortUsersById() {
-        std::sort(users.begin(), users.end(),
-            [](const auto& a, const auto& b) {
-                return a->getId() < b->getId();
-            });
+    constexpr int levelOf(std::string_view name) const {
+        int index = indexOf(name);
+        return index >= 0 ? specs[index].requiredAccessLevel : -1;
     }
+};
 
-    void displayAllUsers() const {
-        for (const auto& user : users) {
-            user->displayInfo();
+template<size_t N>
+constexpr PerfectHashRegistry<N> makePerfectHashRegistry(const FixedResourceSpec (&list)[N]) {
+    return PerfectHashRegistry<N>(list);
+}
+
+// Resource drawn from a compile-time registry; usable as AccessControlSystem<FixedResource<Registry>>.
+// Its handle is the name's position in the registry and its name the registry's own text, so resolving
+// a name is the compile-time perfect hash alone and nothing is built or locked at run time. Names outside the registry are rejected, and a resource
+// constructed from its name alone takes the registry's level.
+template<const auto& Registry>
+class FixedResource : public Resource {
+private:
+    static int indexOf(std::string_view name) {
+        int index = Registry.indexOf(name);
+        if (index < 0) {
+            throw std::invalid_argument("Resource '" + std::string(name) + "' is not in the registry");
         }
+        return index;
     }
 
-    void displayAllResources() const {
-        for (const auto& resource : resources) {
-            std::cout << "Resource: " << resource.getName()
-                << ", Required access level: "
-                << resource.getRequiredAccessLevel() << std::endl;
-        }
+    FixedResource(int index, int requiredAccessLevel)
+        : Resource(Registry[static_cast<size_t>(index)].name, static_cast<uint32_t>(index), requiredAccessLevel) {
     }
 
-    void saveToFile(const std::string& filename) const {
-        std::ofstream out(filename);
-        if (!out) {
-            throw std::runtime_error("Failed to open file for writing");
-        }
+public:
+    explicit FixedResource(std::string_view name) : FixedResource(name, Registry.levelOf(name)) {}
 
-        out << users.size() << '\n';
-        for (const auto& user : users) {
-            user->saveToFile(out);
-        }
+    FixedResource(std::string_view name, int requiredAccessLevel) : FixedResource(indexOf(name), requiredAccessLevel) {}
 
-        out << resources.size() << '\n';
-        for (const auto& resource : resources) {
-            resource.saveToFile(out);
-        }
+    static int handleOf(std::string_view name) { return Registry.indexOf(name); }
+
+    static std::string nameOf(uint32_t handle) {
+        return handle < Registry.size() ? std::string(Registry[handle].name) : std::string();
     }
 
-    void loadFromFile(const std::string& filename) {
-        std::ifstream in(filename);
-        if (!in) {
-            throw std::runtime_error("Failed to open file for reading");
-        }
+    static constexpr int defaultLevel(std::string_view name) { return Registry.levelOf(name); }
 
-        users.clear();
-        resources.clear();
+    void setName(const std::string& newName) override {
+        int index = indexOf(newName);
+        rename(Registry[static_cast<size_t>(index)].name, static_cast<uint32_t>(index));
+    }
 
-        size_t userCount;
-        in >> userCount;
+    void loadFromFile(std::ifstream& in) override {
+        std::string newName;
+        std::getline(in, newName);
+        setName(newName);
+        int requiredAccessLevel;
+        in >> requiredAccessLevel;
         in.ignore();
+        setRequiredAccessLevel(requiredAccessLevel);
+    }
+};
 
-        for (size_t i = 0; i < userCount; ++i) {
-            std::string userType;
-            std::getline(in, userType);
+// Structure-of-arrays mirror of the user table: row i describes users[i] of the owning system
+class UserColumns {
+private:
+    std::vector<int> ids;
+    std::vector<int> accessLevels;
+    std::vector<uint32_t> permissionMasks;
+    std::vector<UserType> types;
+
+#ifdef ACS_HAVE_SSE2
+    // All-ones lanes for rows i..i+3 with level >= minLevel or a permission bit in grantMask. The level
+    // test is "not below minLevel" rather than "above minLevel - 1", which would overflow at INT_MIN.
+    __m128i matchLanes(size_t i, __m128i minLevel, __m128i grantMask, bool useGrants) const {
+        __m128i levels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(accessLevels.data() + i));
+        __m128i match = _mm_xor_si128(_mm_cmplt_epi32(levels, minLevel), _mm_set1_epi32(-1));
+        if (useGrants) {
+            __m128i masks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(permissionMasks.data() + i));
+            __m128i noHit = _mm_cmpeq_epi32(_mm_and_si128(masks, grantMask), _mm_setzero_si128());
+            match = _mm_or_si128(match, _mm_andnot_si128(noHit, _mm_set1_epi32(-1)));
+        }
+        return match;
+    }
+#endif
+
+    bool matches(size_t row, int minLevel, uint32_t grantMask) const {
+        return accessLevels[row] >= minLevel || (permissionMasks[row] & grantMask) != 0;
+    }
+
+public:
+    void clear() {
+        ids.clear();
+        accessLevels.clear();
+        permissionMasks.clear();
+        types.clear();
+    }
+
+    void reserve(size_t n) {
+        ids.reserve(n);
+        accessLevels.reserve(n);
+        permissionMasks.reserve(n);
+        types.reserve(n);
+    }
+
+    void push_back(const User& user) {
+        ids.push_back(user.getId());
+        accessLevels.push_back(user.getAccessLevel());
+        permissionMasks.push_back(user.getPermissionMask());
+        types.push_back(user.getType());
+    }
 
-            std::unique_ptr<User> user;
-            if (userType == "Student") {
-                user = std::make_unique<Student>("", 0, 0, "");
+    size_t size() const { return ids.size(); }
+    int id(size_t row) const { return ids[row]; }
+    int accessLevel(size_t row) const { return accessLevels[row]; }
+    uint32_t permissionMask(size_t row) const { return permissionMasks[row]; }
+    UserType type(size_t row) const { return types[row]; }
+
+    void setAccessLevel(size_t row, int level) { accessLevels[row] = level; }
+    void setPermissionMask(size_t row, uint32_t mask) { permissionMasks[row] = mask; }
+
+    // Rows with accessLevel >= minLevel or any permission bit in grantMask
+    size_t countWithAccess(int minLevel, uint32_t grantMask = 0) const {
+        const size_t n = ids.size();
+        size_t i = 0;
+        size_t result = 0;
+#ifdef ACS_HAVE_SSE2
+        const __m128i threshold = _mm_set1_epi32(minLevel);
+        const __m128i grants = _mm_set1_epi32(static_cast<int>(grantMask));
+        const bool useGrants = grantMask != 0;
+        __m128i counts = _mm_setzero_si128();
+        // Matching lanes are -1; flush the 32-bit lane counters before they can overflow
+        while (i + 4 <= n) {
+            size_t blockEnd = std::min(n & ~size_t(3), i + (size_t(1) << 30));
+            for (; i < blockEnd; i += 4) {
+                counts = _mm_sub_epi32(counts, matchLanes(i, threshold, grants, useGrants));
             }
-            else if (userType == "Teacher") {
-                user = std::make_unique<Teacher>("", 0, 0, "");
+            alignas(16) uint32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), counts);
+            result += size_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+            counts = _mm_setzero_si128();
+        }
+#endif
+        for (; i < n; ++i) {
+            result += matches(i, minLevel, grantMask);
+        }
+        return result;
+    }
+
+    std::vector<int> idsWithAccess(int minLevel, uint32_t grantMask = 0) const {
+        // Counting first is another cheap scan, and lets the gather loop write without reallocating
+        std::vector<int> result(countWithAccess(minLevel, grantMask));
+        int* out = result.data();
+        const size_t n = ids.size();
+        size_t i = 0;
+#ifdef ACS_HAVE_SSE2
+        const __m128i threshold = _mm_set1_epi32(minLevel);
+        const __m128i grants = _mm_set1_epi32(static_cast<int>(grantMask));
+        const bool useGrants = grantMask != 0;
+        for (; i + 4 <= n; i += 4) {
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(matchLanes(i, threshold, grants, useGrants)));
+            if (mask == 0xF) {
+                out[0] = ids[i];
+                out[1] = ids[i + 1];
+                out[2] = ids[i + 2];
+                out[3] = ids[i + 3];
+                out += 4;
+                continue;
             }
-            else if (userType == "Administrator") {
-                user = std::make_unique<Administrator>("", 0, 0, "");
+            for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+                if (mask & 1) {
+                    *out++ = ids[i + lane];
+                }
             }
-            else {
-                throw std::runtime_error("Unknown user type in file");
+        }
+#endif
+        for (; i < n; ++i) {
+            if (matches(i, minLevel, grantMask)) {
+                *out++ = ids[i];
             }
+        }
+        return result;
+    }
+};
+
+// Sorted (key, row) entries with incremental maintenance: inserts go to an unsorted tail and erases to a
+// pending list, and both are applied by one sort, merge and compaction pass on the next query. Updates
+// cost O(1) each; a run of them between queries costs a single O(n) pass rather than one per update.
+// Concurrent const queries are safe: the first one after an update applies it under a mutex.
+class OrderedIndex {
+public:
+    struct Entry {
+        int key;
+        size_t row;
 
-            user->loadFromFile(in);
-            users.push_back(std::move(user));
+        bool operator<(const Entry& other) const {
+            return key != other.key ? key < other.key : row < other.row;
         }
+    };
 
-        size_t resourceCount;
-        in >> resourceCount;
-        in.ignore();
+private:
+    mutable std::vector<Entry> entries;
+    mutable size_t sortedCount = 0;
+    mutable std::vector<Entry> erased; // not yet removed from entries
+    mutable std::atomic<bool> unsettled{ false };
+    mutable std::mutex settling;
 
-        for (size_t i = 0; i < resourceCount; ++i) {
-            T resource("", 0);
-            resource.loadFromFile(in);
-            resources.push_back(resource);
+    void settle() const {
+        if (!unsettled.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(settling);
+        if (unsettled.load(std::memory_order_relaxed)) {
+            apply();
+            unsettled.store(false, std::memory_order_release);
         }
     }
-};
 
-int main() {
-    try {
-        AccessControlSystem<Resource> system;
+    void apply() const {
+        if (sortedCount != entries.size()) {
+            auto middle = entries.begin() + static_cast<std::ptrdiff_t>(sortedCount);
+            std::sort(middle, entries.end());
+            std::inplace_merge(entries.begin(), middle, entries.end());
+            sortedCount = entries.size();
+        }
+        if (erased.empty()) {
+            return;
+        }
+        std::sort(erased.begin(), erased.end());
+        auto next = erased.begin();
+        auto kept = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            while (next != erased.end() && *next < *it) {
+                ++next;
+            }
+            if (next != erased.end() && !(*it < *next)) {
+                ++next; // each pending erase removes one matching entry
+                continue;
+            }
+            *kept++ = *it;
+        }
+        entries.erase(kept, entries.end());
+        sortedCount = entries.size();
+        erased.clear();
+    }
 
-        system.addUser<Student>("Shevchenko Nikita", 1, 1, "Group 03");
-        system.addUser<Student>("Kuviko Daniil", 431, 1, "Group 04");
-        system.addUser<Student>("Khara Andrey", 33, 1, "Group 02");
-        system.addUser<Student>("Vorobyova Veronica", 4, 1, "Group 05");
-        system.addUser<Teacher>("Podkolzina Lyubov Alexandrovna", 157, 2, "Institute of Cross-Cutting Technologies");
-        system.addUser<Administrator>("Zhidkova Valeria Yuryevna", 746, 3, "Assistant");
-        system.addUser<Administrator>("Dibrov Alexander Alexandrovich", 107, 4, "Head of the Academic Support Sector");
-        system.addUser<Administrator>("Markarian Yulia Artyomovna", 803, 5, "Director of Institute");
+public:
+    void clear() {
+        entries.clear();
+        sortedCount = 0;
+        erased.clear();
+        unsettled.store(false, std::memory_order_relaxed);
+    }
 
-        system.addResource(Resource("Audience 1-384", 1));
-        system.addResource(Resource("Laboratory 202", 3));
-        system.addResource(Resource("Scientific library", 2));
-        system.addResource(Resource("Dean's office", 4));
-        system.addResource(Resource("Director's office", 5));
+    void reserve(size_t n) { entries.reserve(n); }
 
-        std::cout << "All users:\n";
-        system.displayAllUsers();
+    // Updates must not run concurrently with queries
+    void insert(int key, size_t row) {
+        entries.push_back(Entry{ key, row });
+        unsettled.store(true, std::memory_order_relaxed);
+    }
 
-        std::cout << "\nAll resources:\n";
-        system.displayAllResources();
+    // The entry must be present (inserted and not yet erased)
+    void erase(int key, size_t row) {
+        erased.push_back(Entry{ key, row });
+        unsettled.store(true, std::memory_order_relaxed);
+    }
 
-        std::cout << "\nAccess check:\n";
-        std::cout << system.checkAccess(001, "Audience 1-384") << std::endl;
-        std::cout << system.checkAccess(431, "Laboratory 202") << std::endl;
-        std::cout << system.checkAccess(107, "Scientific library") << std::endl;
+    // Entries with lo <= key <= hi, in key order
+    std::pair<const Entry*, const Entry*> range(int lo, int hi) const {
+        settle();
+        const Entry* first = entries.data();
+        const Entry* last = first + entries.size();
+        if (lo > hi) {
+            return { last, last };
+        }
+        auto lower = std::lower_bound(first, last, lo, [](const Entry& e, int key) { return e.key < key; });
+        auto upper = std::upper_bound(lower, last, hi, [](int key, const Entry& e) { return key < e.key; });
+        return { lower, upper };
+    }
+
+    const Entry* begin() const {
+        settle();
+        return entries.data();
+    }
+
+    const Entry* end() const {
+        settle();
+        return entries.data() + entries.size();
+    }
+};
+
+// Resource paths such as "Main/3/Laboratory 202" as a trie keyed by path segment. A node either sets its
+// own required level or inherits its parent's; the effective level of every node is kept memoized, and a
+// change is pushed down only through the subtree that inherits it, stopping at explicit overrides.
+class ResourceTree {
+private:
+    struct Node {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+        int explicitLevel = -1; // -1 inherits the parent's effective level
+        int effectiveLevel = 0;
+        bool isResource = false;
+    };
+
+    Node root;
+
+    template<typename Fn>
+    static bool forEachSegment(std::string_view path, Fn fn) {
+        while (true) {
+            size_t slash = path.find('/');
+            std::string_view segment = path.substr(0, slash);
+            if (segment.empty() || !fn(segment)) {
+                return false;
+            }
+            if (slash == std::string_view::npos) {
+                return true;
+            }
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    // Returns the node for path and its parent's effective level, creating missing nodes
+    Node& nodeFor(std::string_view path, int& parentLevel) {
+        Node* node = &root;
+        parentLevel = root.effectiveLevel;
+        bool valid = forEachSegment(path, [&](std::string_view segment) {
+            parentLevel = node->effectiveLevel;
+            auto child = node->children.find(segment);
+            if (child == node->children.end()) {
+                auto created = std::make_unique<Node>();
+                created->effectiveLevel = node->effectiveLevel;
+                child = node->children.emplace(std::string(segment), std::move(created)).first;
+            }
+            node = child->second.get();
+            return true;
+        });
+        if (!valid) {
+            throw std::invalid_argument("Invalid resource path '" + std::string(path) + "'");
+        }
+        return *node;
+    }
+
+    const Node* find(std::string_view path) const {
+        const Node* node = &root;
+        bool found = forEachSegment(path, [&](std::string_view segment) {
+            auto child = node->children.find(segment);
+            node = child != node->children.end() ? child->second.get() : nullptr;
+            return node != nullptr;
+        });
+        return found ? node : nullptr;
+    }
+
+    template<typename Fn>
+    static void propagate(Node& node, int level, std::string& path, Fn& onChanged) {
+        if (node.effectiveLevel == level) {
+            return;
+        }
+        node.effectiveLevel = level;
+        if (node.isResource) {
+            onChanged(path, level);
+        }
+        for (auto& child : node.children) {
+            if (child.second->explicitLevel < 0) {
+                size_t length = path.size();
+                path.append("/").append(child.first);
+                propagate(*child.second, level, path, onChanged);
+                path.resize(length);
+            }
+        }
+    }
+
+public:
+    // Sets (level >= 0) or clears (level = -1) the node's own level; onChanged(path, level) is called for
+    // every resource node whose effective level changed as a result
+    template<typename Fn>
+    void setLevel(std::string_view path, int level, Fn onChanged) {
+        if (level < -1) {
+            throw std::invalid_argument("Required access level cannot be negative");
+        }
+        int parentLevel;
+        Node& node = nodeFor(path, parentLevel);
+        node.explicitLevel = level;
+        std::string fullPath(path);
+        propagate(node, level >= 0 ? level : parentLevel, fullPath, onChanged);
+    }
+
+    // Marks the node as a resource and returns its effective level
+    int addResource(std::string_view path) {
+        int parentLevel;
+        Node& node = nodeFor(path, parentLevel);
+        node.isResource = true;
+        return node.effectiveLevel;
+    }
+
+    // O(path depth); -1 for a path that is not in the tree
+    int effectiveLevel(std::string_view path) const {
+        const Node* node = find(path);
+        return node ? node->effectiveLevel : -1;
+    }
+
+    void clear() {
+        root.children.clear();
+    }
+};
+
+enum class UserOrder {
+    Insertion,
+    ById,
+    ByAccessLevel
+};
+
+enum class AccessDecision : uint8_t {
+    Denied,
+    Granted,
+    UserNotFound,
+    ResourceNotFound
+};
+
+struct AccessRequest {
+    int userId;
+    int resource; // interned name handle, see AccessControlSystem::resourceHandle
+};
+
+// Splits [0, count) into contiguous chunks and runs fn(begin, end) on each chunk in its own thread
+template<typename Fn>
+void parallelFor(size_t count, unsigned threadCount, Fn fn) {
+    const size_t minChunk = 16384;
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t chunks = std::min<size_t>(threadCount, (count + minChunk - 1) / minChunk);
+    if (chunks <= 1) {
+        fn(size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t chunkSize = (count + chunks - 1) / chunks;
+    for (size_t begin = chunkSize; begin < count; begin += chunkSize) {
+        workers.emplace_back(fn, begin, std::min(count, begin + chunkSize));
+    }
+    fn(size_t(0), chunkSize);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// User storage policies for AccessControlSystem. A store keeps users in insertion order and addresses
+// them by row; the system builds its id, column and ordered indexes over the rows. Both hand out mutable
+// users from const lookups, so found users can be edited as before.
+
+// The default: one heap object per user behind unique_ptr<User>, dispatched through virtual calls
+class PointerUserStore {
+private:
+    std::vector<std::unique_ptr<User>> users;
+
+public:
+    void reserve(size_t n) { users.reserve(n); }
+    size_t size() const { return users.size(); }
+    void clear() { users.clear(); }
+
+    User& operator[](size_t row) const { return *users[row]; }
+
+    template<typename U, typename... Args>
+    User& emplace(Args&&... args) {
+        users.push_back(std::make_unique<U>(std::forward<Args>(args)...));
+        return *users.back();
+    }
+
+    User& push_back(std::unique_ptr<User> user) {
+        users.push_back(std::move(user));
+        return *users.back();
+    }
+
+    void pop_back() { users.pop_back(); }
+
+    void assign(std::vector<std::unique_ptr<User>> loaded) { users = std::move(loaded); }
+
+    template<typename Fn>
+    void forEach(Fn fn) const {
+        for (const auto& user : users) {
+            fn(*user);
+        }
+    }
+
+    // Users section of AccessControlSystem::saveToFile
+    void saveToFile(std::ofstream& out) const {
+        out << users.size() << '\n';
+        for (const auto& user : users) {
+            user->saveToFile(out);
+        }
+    }
+};
+
+using UserRecord = std::variant<Student, Teacher, Administrator>;
+
+// Users held by value in one contiguous vector. Iteration and save dispatch with std::visit on the
+// concrete (final) type, so there is no per-user heap object or virtual call. Adding a user may move the
+// others, which invalidates pointers to them.
+class FlatUserStore {
+private:
+    mutable std::vector<UserRecord> records; // mutable: lookups on a const store return mutable users
+
+    static User& base(UserRecord& record) {
+        return std::visit([](auto& user) -> User& { return user; }, record);
+    }
+
+public:
+    void reserve(size_t n) { records.reserve(n); }
+    size_t size() const { return records.size(); }
+    void clear() { records.clear(); }
+
+    User& operator[](size_t row) const { return base(records[row]); }
+
+    template<typename U, typename... Args>
+    User& emplace(Args&&... args) {
+        return std::get<U>(records.emplace_back(std::in_place_type<U>, std::forward<Args>(args)...));
+    }
+
+    // Copies a user from the polymorphic layout
+    User& push_back(std::unique_ptr<User> user) {
+        switch (user->getType()) {
+        case UserType::Student: return emplace<Student>(static_cast<const Student&>(*user));
+        case UserType::Teacher: return emplace<Teacher>(static_cast<const Teacher&>(*user));
+        default: return emplace<Administrator>(static_cast<const Administrator&>(*user));
+        }
+    }
+
+    void pop_back() { records.pop_back(); }
+
+    void assign(std::vector<std::unique_ptr<User>> loaded) {
+        records.clear();
+        records.reserve(loaded.size());
+        for (auto& user : loaded) {
+            push_back(std::move(user));
+        }
+    }
+
+    // fn receives the concrete Student/Teacher/Administrator
+    template<typename Fn>
+    void forEach(Fn fn) const {
+        for (const auto& record : records) {
+            std::visit(fn, record);
+        }
+    }
+
+    void saveToFile(std::ofstream& out) const {
+        out << records.size() << '\n';
+        forEach([&out](const auto& user) { user.saveToFile(out); });
+    }
+};
+
+// Read-only view of a whole file mapped into memory
+class MappedFile {
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    void release() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        if (base && length) munmap(const_cast<char*>(base), length);
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+public:
+    MappedFile() {}
+
+    explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open file for reading");
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = static_cast<size_t>(fileSize.QuadPart);
+        if (length) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            base = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (!base) {
+                release();
+                throw std::runtime_error("Failed to map file");
+            }
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file for reading");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file");
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Failed to map file");
+            }
+            base = static_cast<const char*>(mapped);
+        }
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            release();
+            std::swap(base, other.base);
+            std::swap(length, other.length);
+#ifdef _WIN32
+            std::swap(file, other.file);
+            std::swap(mapping, other.mapping);
+#endif
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { release(); }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// Audit file: u32 magic, u32 version, then AuditEntry records. A ResourceName entry is followed by
+// `userId` bytes of name text and appears once per resource handle per file, before its first decision.
+const uint32_t kAuditMagic = 0x41534341; // "ACSA"
+const uint32_t kAuditVersion = 1;
+
+enum class AuditKind : uint8_t {
+    Decision = 1,
+    ResourceName,
+    Dropped // `userId` decisions from thread `thread` were lost to a full ring buffer
+};
+
+struct AuditEntry {
+    uint8_t kind;
+    uint8_t decision;
+    uint16_t reserved;
+    uint32_t thread;
+    int64_t timestamp; // nanoseconds since the Unix epoch
+    int32_t userId;
+    int32_t resource;
+};
+
+// Single-producer single-consumer ring of fixed-size entries; the owning thread pushes, the writer drains
+class AuditRing {
+private:
+    std::vector<AuditEntry> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{ 0 }; // next slot to write, producer-owned
+    alignas(64) std::atomic<size_t> tail{ 0 }; // next slot to read, consumer-owned
+    alignas(64) std::atomic<uint64_t> dropped{ 0 };
+
+public:
+    const uint32_t thread;
+
+    AuditRing(size_t capacity, uint32_t thread) : slots(capacity), mask(capacity - 1), thread(thread) {}
+
+    void push(const AuditEntry& entry) {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) == slots.size()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        slots[position & mask] = entry;
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    size_t drain(std::vector<AuditEntry>& out) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        size_t end = head.load(std::memory_order_acquire);
+        for (size_t i = position; i != end; ++i) {
+            out.push_back(slots[i & mask]);
+        }
+        tail.store(end, std::memory_order_release);
+        return end - position;
+    }
+
+    uint64_t takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+};
+
+// Records access decisions without blocking the checking thread: each thread writes fixed-size entries
+// into its own lock-free ring, and a background writer drains all rings in batches into size-rotated
+// files <prefix>.<n>.audit. Decisions that find their ring full are counted, and the count is written
+// into the file as a Dropped entry. With keepFiles set, only that many of the newest files are kept.
+// Resource names are looked up with resourceName, which must match the
+// resource type of the systems recording into the log (Resource::nameOf by default). The log must outlive
+// every system that records into it.
+class AuditLog {
+private:
+    std::string prefix;
+    size_t ringCapacity;
+    uint64_t maxFileBytes;
+    size_t keepFiles;
+    std::string (*resourceName)(uint32_t);
+    uint64_t instanceId;
+    std::vector<std::unique_ptr<AuditRing>> rings;
+    std::mutex ringsMutex;
+    std::atomic<uint64_t> droppedTotal{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::thread writer;
+
+    std::ofstream file;
+    uint64_t fileBytes = 0;
+    unsigned fileNumber = 0;
+    std::vector<bool> namedInFile;
+
+    // Ids of the logs in existence, ascending; destroying a log bumps retired so that threads drop
+    // their cached rings of it the next time they look a ring up
+    struct LiveLogs {
+        std::mutex mutex;
+        std::vector<uint64_t> ids;
+        uint64_t nextId = 0;
+        std::atomic<uint64_t> retired{ 0 };
+    };
+
+    static LiveLogs& liveLogs() {
+        static LiveLogs logs;
+        return logs;
+    }
+
+    static uint64_t registerLog() {
+        LiveLogs& logs = liveLogs();
+        std::lock_guard<std::mutex> lock(logs.mutex);
+        logs.ids.push_back(++logs.nextId);
+        return logs.nextId;
+    }
+
+    static void retireLog(uint64_t id) {
+        LiveLogs& logs = liveLogs();
+        std::lock_guard<std::mutex> lock(logs.mutex);
+        logs.ids.erase(std::lower_bound(logs.ids.begin(), logs.ids.end(), id));
+        logs.retired.fetch_add(1, std::memory_order_release);
+    }
+
+    // Each thread keeps its ring of every live log it records to, so switching between logs reuses them.
+    // Returns nullptr when a new ring cannot be allocated; the record is then counted as dropped.
+    AuditRing* ringForThisThread() noexcept {
+        struct Cached {
+            uint64_t log;
+            AuditRing* ring;
+        };
+        thread_local std::vector<Cached> cached;
+        thread_local size_t last = 0;
+        thread_local uint64_t retiredSeen = 0;
+        if (last < cached.size() && cached[last].log == instanceId) {
+            return cached[last].ring;
+        }
+        for (size_t i = 0; i < cached.size(); ++i) {
+            if (cached[i].log == instanceId) {
+                last = i;
+                return cached[i].ring;
+            }
+        }
+        LiveLogs& logs = liveLogs();
+        uint64_t retired = logs.retired.load(std::memory_order_acquire);
+        if (retired != retiredSeen) {
+            std::lock_guard<std::mutex> lock(logs.mutex);
+            cached.erase(std::remove_if(cached.begin(), cached.end(), [&](const Cached& entry) {
+                return !std::binary_search(logs.ids.begin(), logs.ids.end(), entry.log);
+            }), cached.end());
+            retiredSeen = retired;
+        }
+        try {
+            cached.reserve(cached.size() + 1);
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            rings.reserve(rings.size() + 1);
+            rings.push_back(std::make_unique<AuditRing>(ringCapacity, static_cast<uint32_t>(rings.size())));
+            cached.push_back(Cached{ instanceId, rings.back().get() });
+            last = cached.size() - 1;
+            return cached.back().ring;
+        }
+        catch (...) {
+            return nullptr;
+        }
+    }
+
+    void openNextFile() {
+        file.close();
+        std::string filename = prefix + "." + std::to_string(fileNumber++) + ".audit";
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open audit file " + filename);
+        }
+        if (keepFiles && fileNumber > keepFiles) {
+            std::remove((prefix + "." + std::to_string(fileNumber - 1 - keepFiles) + ".audit").c_str());
+        }
+        uint32_t header[2] = { kAuditMagic, kAuditVersion };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        fileBytes = sizeof(header);
+        namedInFile.clear();
+    }
+
+    void append(const AuditEntry& entry, const char* extra = nullptr, size_t extraSize = 0) {
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        if (extraSize) {
+            file.write(extra, static_cast<std::streamsize>(extraSize));
+        }
+        fileBytes += sizeof(entry) + extraSize;
+    }
+
+    void writeBatch(const std::vector<AuditEntry>& batch) {
+        for (const AuditEntry& entry : batch) {
+            if (fileBytes >= maxFileBytes) {
+                openNextFile();
+            }
+            if (entry.kind == static_cast<uint8_t>(AuditKind::Decision) && entry.resource >= 0) {
+                size_t handle = static_cast<size_t>(entry.resource);
+                if (handle >= namedInFile.size()) {
+                    namedInFile.resize(handle + 1, false);
+                }
+                if (!namedInFile[handle]) {
+                    namedInFile[handle] = true;
+                    std::string name = resourceName(static_cast<uint32_t>(handle));
+                    AuditEntry nameEntry = {};
+                    nameEntry.kind = static_cast<uint8_t>(AuditKind::ResourceName);
+                    nameEntry.timestamp = entry.timestamp;
+                    nameEntry.userId = static_cast<int32_t>(name.size());
+                    nameEntry.resource = entry.resource;
+                    append(nameEntry, name.data(), name.size());
+                }
+            }
+            append(entry);
+        }
+    }
+
+    // One pass over all rings; returns the number of entries written
+    size_t drainOnce(std::vector<AuditEntry>& batch) {
+        std::vector<AuditRing*> current;
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            for (auto& ring : rings) {
+                current.push_back(ring.get());
+            }
+        }
+        batch.clear();
+        for (AuditRing* ring : current) {
+            ring->drain(batch);
+            uint64_t lost = ring->takeDropped();
+            if (lost) {
+                droppedTotal.fetch_add(lost, std::memory_order_relaxed);
+                AuditEntry entry = {};
+                entry.kind = static_cast<uint8_t>(AuditKind::Dropped);
+                entry.thread = ring->thread;
+                entry.timestamp = now();
+                entry.userId = static_cast<int32_t>(std::min<uint64_t>(lost, INT32_MAX));
+                batch.push_back(entry);
+            }
+        }
+        writeBatch(batch);
+        if (!batch.empty()) {
+            file.flush();
+        }
+        return batch.size();
+    }
+
+    void writerLoop() {
+        std::vector<AuditEntry> batch;
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (drainOnce(batch) == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+        while (drainOnce(batch) != 0) {
+        }
+    }
+
+public:
+    // keepFiles == 0 keeps every file
+    explicit AuditLog(const std::string& prefix, size_t ringCapacity = 1 << 14, uint64_t maxFileBytes = 64ull << 20,
+        size_t keepFiles = 0, std::string (*resourceName)(uint32_t) = &Resource::nameOf)
+        : prefix(prefix), ringCapacity(ringCapacity), maxFileBytes(maxFileBytes), keepFiles(keepFiles), resourceName(resourceName) {
+        if (ringCapacity == 0 || (ringCapacity & (ringCapacity - 1)) != 0) {
+            throw std::invalid_argument("Audit ring capacity must be a power of two");
+        }
+        openNextFile();
+        instanceId = registerLog();
+        writer = std::thread(&AuditLog::writerLoop, this);
+    }
+
+    // Drains everything recorded so far before closing the file
+    ~AuditLog() {
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        retireLog(instanceId);
+    }
+
+    AuditLog(const AuditLog&) = delete;
+    AuditLog& operator=(const AuditLog&) = delete;
+
+    static int64_t now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void record(int userId, int resource, AccessDecision decision) noexcept {
+        AuditRing* ring = ringForThisThread();
+        if (!ring) {
+            droppedTotal.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        AuditEntry entry = {};
+        entry.kind = static_cast<uint8_t>(AuditKind::Decision);
+        entry.decision = static_cast<uint8_t>(decision);
+        entry.thread = ring->thread;
+        entry.timestamp = now();
+        entry.userId = userId;
+        entry.resource = resource;
+        ring->push(entry);
+    }
+
+    // Decisions lost to full rings so far (only counted once the writer has visited the ring)
+    uint64_t droppedRecords() const { return droppedTotal.load(std::memory_order_relaxed); }
+};
+
+const char* accessDecisionName(AccessDecision decision) {
+    switch (decision) {
+    case AccessDecision::Denied: return "denied";
+    case AccessDecision::Granted: return "granted";
+    case AccessDecision::UserNotFound: return "user not found";
+    case AccessDecision::ResourceNotFound: return "resource not found";
+    }
+    return "unknown";
+}
+
+// Prints an audit file as text, one entry per line
+int decodeAuditFile(const std::string& filename, std::ostream& out) {
+    MappedFile file(filename);
+    const char* cursor = file.data();
+    const char* end = cursor + file.size();
+    uint32_t header[2];
+    if (file.size() < sizeof(header) || (std::memcpy(header, cursor, sizeof(header)), header[0] != kAuditMagic)) {
+        std::cerr << filename << ": not an audit file" << std::endl;
+        return 1;
+    }
+    if (header[1] != kAuditVersion) {
+        std::cerr << filename << ": unsupported audit file version " << header[1] << std::endl;
+        return 1;
+    }
+    cursor += sizeof(header);
+
+    std::map<int32_t, std::string> names;
+    while (end - cursor >= static_cast<std::ptrdiff_t>(sizeof(AuditEntry))) {
+        AuditEntry entry;
+        std::memcpy(&entry, cursor, sizeof(entry));
+        cursor += sizeof(entry);
+
+        std::time_t seconds = static_cast<std::time_t>(entry.timestamp / 1000000000);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::gmtime(&seconds));
+        char fraction[16];
+        std::snprintf(fraction, sizeof(fraction), ".%09lld", static_cast<long long>(entry.timestamp % 1000000000));
+
+        switch (static_cast<AuditKind>(entry.kind)) {
+        case AuditKind::ResourceName:
+            if (entry.userId < 0 || end - cursor < entry.userId) {
+                std::cerr << filename << ": truncated resource name" << std::endl;
+                return 1;
+            }
+            names[entry.resource] = std::string(cursor, static_cast<size_t>(entry.userId));
+            cursor += entry.userId;
+            break;
+        case AuditKind::Decision: {
+            auto name = names.find(entry.resource);
+            out << stamp << fraction << " thread " << entry.thread << " user " << entry.userId << " -> '"
+                << (name != names.end() ? name->second : "#" + std::to_string(entry.resource)) << "': "
+                << accessDecisionName(static_cast<AccessDecision>(entry.decision)) << '\n';
+            break;
+        }
+        case AuditKind::Dropped:
+            out << stamp << fraction << " thread " << entry.thread << " dropped " << entry.userId << " decisions\n";
+            break;
+        default:
+            std::cerr << filename << ": unknown entry kind " << int(entry.kind) << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Binary snapshot layout (host byte order, all sections 8-byte aligned):
+//   SnapshotHeader | user records | resource records | grant attributes | user id slots | resource name slots | string heap
+// Grant attributes are listed in bit order: record i is the attribute behind bit 1 << i of the masks.
+// Slots are open-addressing tables of (row + 1), 0 meaning empty, so lookups work straight from the mapping.
+const uint32_t kSnapshotMagic = 0x4E534341; // "ACSN"
+const uint32_t kSnapshotVersion = 2;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t userCount;
+    uint32_t resourceCount;
+    uint32_t userSlotCount;
+    uint32_t resourceSlotCount;
+    uint32_t grantCount;
+    uint32_t reserved;
+    uint64_t usersOffset;
+    uint64_t resourcesOffset;
+    uint64_t grantsOffset;
+    uint64_t userSlotsOffset;
+    uint64_t resourceSlotsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+struct SnapshotUser {
+    int32_t id;
+    int32_t accessLevel;
+    uint32_t type;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t attributeOffset;
+    uint32_t attributeLength;
+    uint32_t permissionMask;
+};
+
+struct SnapshotResource {
+    int32_t requiredAccessLevel;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t grantMask;
+};
+
+struct SnapshotGrant {
+    uint32_t kind; // PermissionKind
+    uint32_t valueOffset;
+    uint32_t valueLength;
+    uint32_t reserved;
+};
+
+inline uint32_t snapshotIdSlot(int id, uint32_t slotCount) {
+    return static_cast<uint32_t>((static_cast<uint32_t>(id) * 0x9E3779B97F4A7C15ull) >> 32) & (slotCount - 1);
+}
+
+// FNV-1a: unlike std::hash its value is fixed, so it can be stored in files
+inline uint32_t snapshotNameSlot(std::string_view name, uint32_t slotCount) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32)) & (slotCount - 1);
+}
+
+// Same rule as Resource::checkAccess
+inline bool snapshotGrants(const SnapshotUser& user, const SnapshotResource& resource) {
+    return (user.accessLevel >= resource.requiredAccessLevel) | ((user.permissionMask & resource.grantMask) != 0);
+}
+
+class SnapshotWriter {
+private:
+    std::vector<SnapshotUser> userRecords;
+    std::vector<SnapshotResource> resourceRecords;
+    std::vector<SnapshotGrant> grantRecords;
+    std::string strings;
+
+    uint32_t addString(std::string_view value, uint32_t& length) {
+        if (strings.size() + value.size() > UINT32_MAX) {
+            throw std::runtime_error("Snapshot string heap exceeds 4 GiB");
+        }
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        length = static_cast<uint32_t>(value.size());
+        strings += value;
+        return offset;
+    }
+
+    static uint32_t slotCountFor(size_t rows) {
+        uint32_t count = 8;
+        while (count < rows * 2) {
+            count <<= 1;
+        }
+        return count;
+    }
+
+    static uint64_t align8(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+public:
+    void addUser(const User& user) {
+        SnapshotUser record = {};
+        record.id = user.getId();
+        record.accessLevel = user.getAccessLevel();
+        record.type = static_cast<uint32_t>(user.getType());
+        record.nameOffset = addString(user.getName(), record.nameLength);
+        record.attributeOffset = addString(userAttribute(user), record.attributeLength);
+        record.permissionMask = user.getPermissionMask();
+        userRecords.push_back(record);
+    }
+
+    void addResource(std::string_view name, int requiredAccessLevel, uint32_t grantMask) {
+        SnapshotResource record = {};
+        record.requiredAccessLevel = requiredAccessLevel;
+        record.grantMask = grantMask;
+        record.nameOffset = addString(name, record.nameLength);
+        resourceRecords.push_back(record);
+    }
+
+    // Call in bit order (see PermissionRegistry)
+    void addGrant(PermissionKind kind, std::string_view value) {
+        SnapshotGrant record = {};
+        record.kind = static_cast<uint32_t>(kind);
+        record.valueOffset = addString(value, record.valueLength);
+        grantRecords.push_back(record);
+    }
+
+    std::vector<char> finish() const {
+        SnapshotHeader header = {};
+        header.magic = kSnapshotMagic;
+        header.version = kSnapshotVersion;
+        header.userCount = static_cast<uint32_t>(userRecords.size());
+        header.resourceCount = static_cast<uint32_t>(resourceRecords.size());
+        header.userSlotCount = slotCountFor(userRecords.size());
+        header.resourceSlotCount = slotCountFor(resourceRecords.size());
+        header.grantCount = static_cast<uint32_t>(grantRecords.size());
+        header.usersOffset = align8(sizeof(SnapshotHeader));
+        header.resourcesOffset = align8(header.usersOffset + userRecords.size() * sizeof(SnapshotUser));
+        header.grantsOffset = align8(header.resourcesOffset + resourceRecords.size() * sizeof(SnapshotResource));
+        header.userSlotsOffset = align8(header.grantsOffset + grantRecords.size() * sizeof(SnapshotGrant));
+        header.resourceSlotsOffset = align8(header.userSlotsOffset + uint64_t(header.userSlotCount) * sizeof(uint32_t));
+        header.stringsOffset = align8(header.resourceSlotsOffset + uint64_t(header.resourceSlotCount) * sizeof(uint32_t));
+        header.stringsSize = strings.size();
+
+        std::vector<char> image(header.stringsOffset + strings.size(), 0);
+        std::memcpy(image.data(), &header, sizeof(header));
+        if (!userRecords.empty()) {
+            std::memcpy(image.data() + header.usersOffset, userRecords.data(), userRecords.size() * sizeof(SnapshotUser));
+        }
+        if (!resourceRecords.empty()) {
+            std::memcpy(image.data() + header.resourcesOffset, resourceRecords.data(), resourceRecords.size() * sizeof(SnapshotResource));
+        }
+        if (!grantRecords.empty()) {
+            std::memcpy(image.data() + header.grantsOffset, grantRecords.data(), grantRecords.size() * sizeof(SnapshotGrant));
+        }
+        std::memcpy(image.data() + header.stringsOffset, strings.data(), strings.size());
+
+        uint32_t* userSlots = reinterpret_cast<uint32_t*>(image.data() + header.userSlotsOffset);
+        for (uint32_t row = 0; row < header.userCount; ++row) {
+            uint32_t slot = snapshotIdSlot(userRecords[row].id, header.userSlotCount);
+            while (userSlots[slot] != 0) {
+                if (userRecords[userSlots[slot] - 1].id == userRecords[row].id) {
+                    throw std::runtime_error("Duplicate user ID: " + std::to_string(userRecords[row].id));
+                }
+                slot = (slot + 1) & (header.userSlotCount - 1);
+            }
+            userSlots[slot] = row + 1;
+        }
+
+        uint32_t* resourceSlots = reinterpret_cast<uint32_t*>(image.data() + header.resourceSlotsOffset);
+        for (uint32_t row = 0; row < header.resourceCount; ++row) {
+            std::string_view name(strings.data() + resourceRecords[row].nameOffset, resourceRecords[row].nameLength);
+            uint32_t slot = snapshotNameSlot(name, header.resourceSlotCount);
+            while (resourceSlots[slot] != 0) {
+                slot = (slot + 1) & (header.resourceSlotCount - 1);
+            }
+            resourceSlots[slot] = row + 1;
+        }
+        return image;
+    }
+};
+
+// Validated, read-only access to a snapshot image; lookups are served straight from the mapped bytes
+class SnapshotView {
+private:
+    MappedFile file;
+    std::vector<char> owned;
+    const char* base = nullptr;
+    const SnapshotHeader* header = nullptr;
+
+    template<typename Record>
+    const Record* section(uint64_t offset) const {
+        return reinterpret_cast<const Record*>(base + offset);
+    }
+
+    static bool fits(uint64_t offset, uint64_t bytes, uint64_t limit) {
+        return offset <= limit && bytes <= limit - offset;
+    }
+
+    void validate(size_t size) const {
+        if (size < sizeof(SnapshotHeader) || header->magic != kSnapshotMagic) {
+            throw std::runtime_error("Not an access control snapshot");
+        }
+        if (header->version != kSnapshotVersion) {
+            throw std::runtime_error("Unsupported snapshot version " + std::to_string(header->version));
+        }
+        auto powerOfTwo = [](uint32_t n) { return n != 0 && (n & (n - 1)) == 0; };
+        if (!powerOfTwo(header->userSlotCount) || !powerOfTwo(header->resourceSlotCount)
+            || header->userSlotCount < header->userCount || header->resourceSlotCount < header->resourceCount
+            || header->grantCount > PermissionRegistry::kMaxGrants
+            || (header->usersOffset | header->resourcesOffset | header->grantsOffset | header->userSlotsOffset | header->resourceSlotsOffset) % 8 != 0
+            || !fits(header->usersOffset, uint64_t(header->userCount) * sizeof(SnapshotUser), size)
+            || !fits(header->resourcesOffset, uint64_t(header->resourceCount) * sizeof(SnapshotResource), size)
+            || !fits(header->grantsOffset, uint64_t(header->grantCount) * sizeof(SnapshotGrant), size)
+            || !fits(header->userSlotsOffset, uint64_t(header->userSlotCount) * sizeof(uint32_t), size)
+            || !fits(header->resourceSlotsOffset, uint64_t(header->resourceSlotCount) * sizeof(uint32_t), size)
+            || !fits(header->stringsOffset, header->stringsSize, size)) {
+            throw std::runtime_error("Corrupt snapshot header");
+        }
+
+        const uint64_t heap = header->stringsSize;
+        const SnapshotUser* userRecords = section<SnapshotUser>(header->usersOffset);
+        for (uint32_t i = 0; i < header->userCount; ++i) {
+            const SnapshotUser& record = userRecords[i];
+            if (record.type > static_cast<uint32_t>(UserType::Administrator)
+                || !fits(record.nameOffset, record.nameLength, heap) || !fits(record.attributeOffset, record.attributeLength, heap)) {
+                throw std::runtime_error("Corrupt user record " + std::to_string(i) + " in snapshot");
+            }
+        }
+        const SnapshotResource* resourceRecords = section<SnapshotResource>(header->resourcesOffset);
+        for (uint32_t i = 0; i < header->resourceCount; ++i) {
+            if (!fits(resourceRecords[i].nameOffset, resourceRecords[i].nameLength, heap)) {
+                throw std::runtime_error("Corrupt resource record " + std::to_string(i) + " in snapshot");
+            }
+        }
+        const SnapshotGrant* grantRecords = section<SnapshotGrant>(header->grantsOffset);
+        for (uint32_t i = 0; i < header->grantCount; ++i) {
+            if (grantRecords[i].kind > static_cast<uint32_t>(PermissionKind::Position)
+                || !fits(grantRecords[i].valueOffset, grantRecords[i].valueLength, heap)) {
+                throw std::runtime_error("Corrupt grant record " + std::to_string(i) + " in snapshot");
+            }
+        }
+        auto checkSlots = [](const uint32_t* slots, uint32_t slotCount, uint32_t rows) {
+            for (uint32_t i = 0; i < slotCount; ++i) {
+                if (slots[i] > rows) {
+                    throw std::runtime_error("Corrupt index slot in snapshot");
+                }
+            }
+        };
+        checkSlots(section<uint32_t>(header->userSlotsOffset), header->userSlotCount, header->userCount);
+        checkSlots(section<uint32_t>(header->resourceSlotsOffset), header->resourceSlotCount, header->resourceCount);
+    }
+
+public:
+    explicit SnapshotView(const std::string& filename) : file(filename) {
+        base = file.data();
+        header = reinterpret_cast<const SnapshotHeader*>(base);
+        validate(file.size());
+    }
+
+    // Serves an image built in memory (see AccessControlSystem::buildSnapshotImage)
+    explicit SnapshotView(std::vector<char> image) : owned(std::move(image)) {
+        base = owned.data();
+        header = reinterpret_cast<const SnapshotHeader*>(base);
+        validate(owned.size());
+    }
+
+    SnapshotView(const SnapshotView&) = delete;
+    SnapshotView& operator=(const SnapshotView&) = delete;
+
+    size_t userCount() const { return header->userCount; }
+    size_t resourceCount() const { return header->resourceCount; }
+    size_t grantCount() const { return header->grantCount; }
+
+    const SnapshotUser& user(size_t row) const { return section<SnapshotUser>(header->usersOffset)[row]; }
+    const SnapshotResource& resource(size_t row) const { return section<SnapshotResource>(header->resourcesOffset)[row]; }
+    const SnapshotGrant& grant(size_t bit) const { return section<SnapshotGrant>(header->grantsOffset)[bit]; }
+
+    std::string_view text(uint32_t offset, uint32_t length) const {
+        return std::string_view(base + header->stringsOffset + offset, length);
+    }
+
+    std::string_view name(const SnapshotUser& record) const { return text(record.nameOffset, record.nameLength); }
+    std::string_view attribute(const SnapshotUser& record) const { return text(record.attributeOffset, record.attributeLength); }
+    std::string_view name(const SnapshotResource& record) const { return text(record.nameOffset, record.nameLength); }
+    std::string_view value(const SnapshotGrant& record) const { return text(record.valueOffset, record.valueLength); }
+
+    const SnapshotUser* findUser(int id) const {
+        const uint32_t* slots = section<uint32_t>(header->userSlotsOffset);
+        const uint32_t mask = header->userSlotCount - 1;
+        for (uint32_t slot = snapshotIdSlot(id, header->userSlotCount), probes = 0; probes <= mask; slot = (slot + 1) & mask, ++probes) {
+            if (slots[slot] == 0) {
+                return nullptr;
+            }
+            const SnapshotUser& record = user(slots[slot] - 1);
+            if (record.id == id) {
+                return &record;
+            }
+        }
+        return nullptr;
+    }
+
+    const SnapshotResource* findResource(std::string_view resourceName) const {
+        const uint32_t* slots = section<uint32_t>(header->resourceSlotsOffset);
+        const uint32_t mask = header->resourceSlotCount - 1;
+        for (uint32_t slot = snapshotNameSlot(resourceName, header->resourceSlotCount), probes = 0; probes <= mask; slot = (slot + 1) & mask, ++probes) {
+            if (slots[slot] == 0) {
+                return nullptr;
+            }
+            const SnapshotResource& record = resource(slots[slot] - 1);
+            if (name(record) == resourceName) {
+                return &record;
+            }
+        }
+        return nullptr;
+    }
+
+    AccessDecision decideAccess(int userId, std::string_view resourceName) const {
+        const SnapshotUser* userRecord = findUser(userId);
+        if (!userRecord) {
+            return AccessDecision::UserNotFound;
+        }
+        const SnapshotResource* resourceRecord = findResource(resourceName);
+        if (!resourceRecord) {
+            return AccessDecision::ResourceNotFound;
+        }
+        return snapshotGrants(*userRecord, *resourceRecord) ? AccessDecision::Granted : AccessDecision::Denied;
+    }
+};
+
+enum class ExportFormat {
+    Csv,
+    JsonLines
+};
+
+// Streams the users or resources of a snapshot as CSV or JSON Lines. Records are formatted straight
+// into one reusable buffer (integers with std::to_chars) that is handed to the stream whenever it
+// fills up, so no record allocates.
+class SnapshotExporter {
+private:
+    std::ostream& out;
+    ExportFormat format;
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    void reserve(size_t bytes) {
+        if (buffer.size() - used < bytes) {
+            flush();
+            if (buffer.size() < bytes) {
+                buffer.resize(bytes);
+            }
+        }
+    }
+
+    void put(char c) {
+        reserve(1);
+        buffer[used++] = c;
+    }
+
+    void put(std::string_view text) {
+        reserve(text.size());
+        std::memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    void putNumber(int64_t value) {
+        reserve(24);
+        used = static_cast<size_t>(std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), value).ptr - buffer.data());
+    }
+
+    // CSV fields are quoted only when they contain a separator, a quote or a line break
+    void putCsv(std::string_view text) {
+        if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+            put(text);
+            return;
+        }
+        put('"');
+        for (char c : text) {
+            if (c == '"') {
+                put('"');
+            }
+            put(c);
+        }
+        put('"');
+    }
+
+    void putJson(std::string_view text) {
+        put('"');
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            put(text.substr(start, i - start));
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(static_cast<char>(c));
+            }
+            else {
+                char escaped[7];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                put(std::string_view(escaped, 6));
+            }
+            start = i + 1;
+        }
+        put(text.substr(start));
+        put('"');
+    }
+
+    static std::string_view attributeKey(UserType type) {
+        switch (type) {
+        case UserType::Student: return "group";
+        case UserType::Teacher: return "department";
+        case UserType::Administrator: return "position";
+        }
+        return "attribute";
+    }
+
+public:
+    SnapshotExporter(std::ostream& out, ExportFormat format, size_t bufferSize = 1 << 20)
+        : out(out), format(format), buffer(std::max<size_t>(bufferSize, 64)) {
+    }
+
+    ~SnapshotExporter() {
+        flush();
+    }
+
+    SnapshotExporter(const SnapshotExporter&) = delete;
+    SnapshotExporter& operator=(const SnapshotExporter&) = delete;
+
+    void flush() {
+        out.write(buffer.data(), static_cast<std::streamsize>(used));
+        used = 0;
+    }
+
+    void writeUsers(const SnapshotView& snapshot) {
+        if (format == ExportFormat::Csv) {
+            put("id,name,accessLevel,type,attribute\n");
+        }
+        for (size_t i = 0; i < snapshot.userCount(); ++i) {
+            const SnapshotUser& record = snapshot.user(i);
+            UserType type = static_cast<UserType>(record.type);
+            if (format == ExportFormat::Csv) {
+                putNumber(record.id);
+                put(',');
+                putCsv(snapshot.name(record));
+                put(',');
+                putNumber(record.accessLevel);
+                put(',');
+                put(userTypeName(type));
+                put(',');
+                putCsv(snapshot.attribute(record));
+            }
+            else {
+                put("{\"id\":");
+                putNumber(record.id);
+                put(",\"name\":");
+                putJson(snapshot.name(record));
+                put(",\"accessLevel\":");
+                putNumber(record.accessLevel);
+                put(",\"type\":\"");
+                put(userTypeName(type));
+                put("\",\"");
+                put(attributeKey(type));
+                put("\":");
+                putJson(snapshot.attribute(record));
+                put('}');
+            }
+            put('\n');
+        }
+    }
+
+    void writeResources(const SnapshotView& snapshot) {
+        if (format == ExportFormat::Csv) {
+            put("name,requiredAccessLevel\n");
+        }
+        for (size_t i = 0; i < snapshot.resourceCount(); ++i) {
+            const SnapshotResource& record = snapshot.resource(i);
+            if (format == ExportFormat::Csv) {
+                putCsv(snapshot.name(record));
+                put(',');
+                putNumber(record.requiredAccessLevel);
+            }
+            else {
+                put("{\"name\":");
+                putJson(snapshot.name(record));
+                put(",\"requiredAccessLevel\":");
+                putNumber(record.requiredAccessLevel);
+                put('}');
+            }
+            put('\n');
+        }
+    }
+};
+
+// Writes a whole file and forces it to stable storage before returning
+void writeFileDurably(const std::string& filename, const char* data, size_t size) {
+#ifdef _WIN32
+    int fd = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file for writing");
+    }
+    size_t written = 0;
+    while (written < size) {
+#ifdef _WIN32
+        int chunk = _write(fd, data + written, static_cast<unsigned>(std::min<size_t>(size - written, 1u << 30)));
+#else
+        ssize_t chunk = ::write(fd, data + written, size - written);
+#endif
+        if (chunk <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(chunk);
+    }
+#ifdef _WIN32
+    bool synced = _commit(fd) == 0;
+    _close(fd);
+#else
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+#endif
+    if (written != size || !synced) {
+        throw std::runtime_error("Failed to write " + filename);
+    }
+}
+
+void replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    bool moved = MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool moved = std::rename(from.c_str(), to.c_str()) == 0;
+    if (moved) {
+        // The rename is durable only once the directory entry is: sync the parent directory as well
+        size_t slash = to.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : to.substr(0, slash);
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        moved = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#endif
+    if (!moved) {
+        throw std::runtime_error("Failed to replace " + to);
+    }
+}
+
+bool fileExists(const std::string& filename) {
+    return static_cast<bool>(std::ifstream(filename));
+}
+
+enum class JournalOp : uint8_t {
+    AddUser = 1,
+    SetAccessLevel,
+    SetName,
+    AddResource,
+    SetRequiredAccessLevel,
+    GrantAccess
+};
+
+// Journal record: u32 payload length | u32 payload checksum | payload (u8 op, then op-specific fields)
+class JournalRecord {
+private:
+    std::string bytes;
+
+    void putRaw(const void* data, size_t size) { bytes.append(static_cast<const char*>(data), size); }
+
+public:
+    explicit JournalRecord(JournalOp op) {
+        bytes.assign(8, '\0');
+        bytes.push_back(static_cast<char>(op));
+    }
+
+    JournalRecord& putInt(int32_t value) {
+        putRaw(&value, sizeof(value));
+        return *this;
+    }
+
+    JournalRecord& putString(std::string_view value) {
+        putInt(static_cast<int32_t>(value.size()));
+        putRaw(value.data(), value.size());
+        return *this;
+    }
+
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    // Fills in the framing header and returns the encoded record
+    const std::string& finish() {
+        uint32_t header[2] = { static_cast<uint32_t>(bytes.size() - 8), checksum(bytes.data() + 8, bytes.size() - 8) };
+        std::memcpy(&bytes[0], header, sizeof(header));
+        return bytes;
+    }
+};
+
+class JournalReader {
+private:
+    const char* cursor;
+    const char* end;
+
+public:
+    JournalReader(const char* data, size_t size) : cursor(data), end(data + size) {}
+
+    bool atEnd() const { return cursor == end; }
+
+    // Returns false at the end of the journal or at a torn/corrupt tail record
+    bool next(JournalReader& payload) {
+        uint32_t header[2];
+        if (static_cast<size_t>(end - cursor) < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(header, cursor, sizeof(header));
+        if (header[0] == 0 || header[0] > static_cast<size_t>(end - cursor) - sizeof(header)
+            || JournalRecord::checksum(cursor + sizeof(header), header[0]) != header[1]) {
+            return false;
+        }
+        payload = JournalReader(cursor + sizeof(header), header[0]);
+        cursor += sizeof(header) + header[0];
+        return true;
+    }
+
+    JournalOp op() { return static_cast<JournalOp>(static_cast<uint8_t>(*cursor++)); }
+
+    int32_t getInt() {
+        int32_t value;
+        if (end - cursor < static_cast<std::ptrdiff_t>(sizeof(value))) {
+            throw std::runtime_error("Truncated journal record");
+        }
+        std::memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return value;
+    }
+
+    std::string getString() {
+        int32_t length = getInt();
+        if (length < 0 || end - cursor < length) {
+            throw std::runtime_error("Truncated journal record");
+        }
+        std::string value(cursor, static_cast<size_t>(length));
+        cursor += length;
+        return value;
+    }
+};
+
+// Append-only log of mutations. Appends only copy into a buffer; a background thread writes and fsyncs
+// everything that accumulated during one commit interval together (group commit).
+class ChangeJournal {
+private:
+    std::string filename;
+    int fd = -1;
+    std::string pending;
+    uint64_t appendedSeq = 0;
+    uint64_t durableSeq = 0;
+    bool stopping = false;
+    bool failed = false;
+    std::mutex mutex;
+    std::condition_variable pendingReady;
+    std::condition_variable durable;
+    std::thread flusher;
+    std::chrono::milliseconds commitInterval;
+
+    void openFile() {
+#ifdef _WIN32
+        fd = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+#endif
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open journal " + filename);
+        }
+    }
+
+    void closeFile() {
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    bool writeAndSync(const std::string& batch) {
+        size_t written = 0;
+        while (written < batch.size()) {
+#ifdef _WIN32
+            int chunk = _write(fd, batch.data() + written, static_cast<unsigned>(std::min<size_t>(batch.size() - written, 1u << 30)));
+#else
+            ssize_t chunk = ::write(fd, batch.data() + written, batch.size() - written);
+#endif
+            if (chunk <= 0) {
+                return false;
+            }
+            written += static_cast<size_t>(chunk);
+        }
+#ifdef _WIN32
+        return _commit(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    // Caller holds the lock; it is released around the actual I/O so appends keep flowing
+    void flushLocked(std::unique_lock<std::mutex>& lock) {
+        std::string batch;
+        batch.swap(pending);
+        uint64_t batchSeq = appendedSeq;
+        lock.unlock();
+        bool ok = batch.empty() || writeAndSync(batch);
+        lock.lock();
+        if (!ok) {
+            failed = true;
+        }
+        durableSeq = std::max(durableSeq, batchSeq);
+        durable.notify_all();
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            pendingReady.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (!stopping) {
+                // Let concurrent appends join this group before paying for the fsync
+                pendingReady.wait_for(lock, commitInterval, [this] { return stopping || pending.size() >= (1u << 20); });
+            }
+            flushLocked(lock);
+            if (stopping && pending.empty()) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit ChangeJournal(const std::string& filename, std::chrono::milliseconds commitInterval = std::chrono::milliseconds(2))
+        : filename(filename), commitInterval(commitInterval) {
+        openFile();
+        flusher = std::thread(&ChangeJournal::flushLoop, this);
+    }
+
+    ~ChangeJournal() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        pendingReady.notify_one();
+        flusher.join();
+        closeFile();
+    }
+
+    ChangeJournal(const ChangeJournal&) = delete;
+    ChangeJournal& operator=(const ChangeJournal&) = delete;
+
+    const std::string& getFilename() const { return filename; }
+
+    // Returns the sequence number to pass to waitDurable()
+    uint64_t append(const std::string& record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending += record;
+        pendingReady.notify_one();
+        return ++appendedSeq;
+    }
+
+    void waitDurable(uint64_t seq) {
+        std::unique_lock<std::mutex> lock(mutex);
+        durable.wait(lock, [this, seq] { return durableSeq >= seq; });
+        if (failed) {
+            throw std::runtime_error("Failed to write journal " + filename);
+        }
+    }
+
+    void sync() {
+        uint64_t seq;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            seq = appendedSeq;
+        }
+        waitDurable(seq);
+    }
+
+    // Makes everything appended so far durable, moves it to retiredName and starts an empty journal
+    void rotate(const std::string& retiredName) {
+        std::unique_lock<std::mutex> lock(mutex);
+        flushLocked(lock);
+        if (failed) {
+            throw std::runtime_error("Failed to write journal " + filename);
+        }
+        closeFile();
+        replaceFile(filename, retiredName);
+        openFile();
+    }
+};
+
+// Publishes immutable, reference-counted versions of V without locks (split reference counting).
+// The packed word holds the current version's pointer in its low 48 bits and, in the high 16 bits,
+// the number of readers that are between "saw this pointer" and "counted a reference on it".
+// Acquiring is a fetch_add on the word plus a reference count increment; a writer swapping in a new
+// version hands that in-flight count over to the old version's reference count.
+template<typename V>
+class VersionedPtr {
+private:
+    struct Node {
+        std::atomic<int64_t> refs;
+        V value;
+
+        template<typename... Args>
+        explicit Node(Args&&... args) : refs(1), value(std::forward<Args>(args)...) {}
+    };
+
+    static const uint64_t kPointerMask = (uint64_t(1) << 48) - 1;
+    static const uint64_t kLocalOne = uint64_t(1) << 48;
+
+    mutable std::atomic<uint64_t> word{ 0 };
+
+    static Node* pointerOf(uint64_t packed) {
+        return reinterpret_cast<Node*>(static_cast<uintptr_t>(packed & kPointerMask));
+    }
+
+    static void release(Node* node) {
+        if (node && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete node;
+        }
+    }
+
+public:
+    class Ref {
+    private:
+        Node* node = nullptr;
+
+    public:
+        Ref() {}
+        explicit Ref(Node* node) : node(node) {}
+        Ref(Ref&& other) noexcept : node(other.node) { other.node = nullptr; }
+        Ref& operator=(Ref&& other) noexcept {
+            std::swap(node, other.node);
+            return *this;
+        }
+        Ref(const Ref&) = delete;
+        Ref& operator=(const Ref&) = delete;
+        ~Ref() { release(node); }
+
+        const V* get() const { return node ? &node->value : nullptr; }
+        const V& operator*() const { return node->value; }
+        const V* operator->() const { return &node->value; }
+        explicit operator bool() const { return node != nullptr; }
+    };
+
+    VersionedPtr() {
+        static_assert(sizeof(void*) <= sizeof(uint64_t), "pointers must fit the packed word");
+    }
+
+    VersionedPtr(const VersionedPtr&) = delete;
+    VersionedPtr& operator=(const VersionedPtr&) = delete;
+
+    // Readers must have released their Refs before the owner goes away
+    ~VersionedPtr() { release(pointerOf(word.load(std::memory_order_acquire))); }
+
+    Ref acquire() const {
+        Node* node = pointerOf(word.fetch_add(kLocalOne, std::memory_order_acquire));
+        if (node) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (pointerOf(current) == node) {
+            if (word.compare_exchange_weak(current, current - kLocalOne, std::memory_order_release, std::memory_order_relaxed)) {
+                return Ref(node);
+            }
+        }
+        // A writer replaced the version meanwhile and already moved our in-flight count into node->refs
+        if (node) {
+            node->refs.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return Ref(node);
+    }
+
+    // The publisher may go on updating the new version through the returned reference, as far as V
+    // makes such updates safe for concurrent readers
+    template<typename... Args>
+    V& publish(Args&&... args) {
+        Node* fresh = new Node(std::forward<Args>(args)...);
+        if (reinterpret_cast<uintptr_t>(fresh) & ~static_cast<uintptr_t>(kPointerMask)) {
+            delete fresh;
+            throw std::runtime_error("Address does not fit the 48-bit versioned pointer");
+        }
+        uint64_t previous = word.exchange(reinterpret_cast<uintptr_t>(fresh), std::memory_order_acq_rel);
+        Node* old = pointerOf(previous);
+        if (old) {
+            old->refs.fetch_add(static_cast<int64_t>(previous >> 48), std::memory_order_relaxed);
+            release(old);
+        }
+        return fresh->value;
+    }
+};
+
+// Hierarchical timing wheel over integer ticks: four levels of 64 slots file deadlines up to 2^24 ticks
+// ahead in O(1); later ones wait in the top level and are re-filed each time it cascades. An entry moves
+// down at most once per level before it fires, so expiry costs O(1) per timer.
+class TimerWheel {
+public:
+    struct Timer {
+        int64_t deadline;
+        uint64_t id;
+    };
+
+private:
+    static const unsigned kLevels = 4;
+    static const unsigned kSlotBits = 6;
+    static const int64_t kSlots = int64_t(1) << kSlotBits;
+    static const int64_t kHorizon = int64_t(1) << (kSlotBits * kLevels);
+
+    std::vector<Timer> slots[kLevels][kSlots];
+    std::vector<Timer> overdue; // scheduled at or before current, fired by the next advance
+    size_t filed[kLevels] = {};
+    int64_t current;
+    size_t pending = 0;
+
+    // earliest is the first tick whose slot has not been processed yet
+    void file(const Timer& timer, int64_t earliest) {
+        // Overdue timers go to the next slot processed, far ones to the top level until it cascades
+        int64_t at = std::min(std::max(timer.deadline, earliest), current + kHorizon - 1);
+        unsigned level = 0;
+        while (level + 1 < kLevels && at - current >= (int64_t(1) << (kSlotBits * (level + 1)))) {
+            ++level;
+        }
+        slots[level][(at >> (kSlotBits * level)) & (kSlots - 1)].push_back(timer);
+        ++filed[level];
+    }
+
+public:
+    explicit TimerWheel(int64_t now) : current(now) {}
+
+    size_t size() const { return pending; }
+
+    void schedule(int64_t deadline, uint64_t id) {
+        if (deadline <= current) {
+            overdue.push_back(Timer{ deadline, id });
+        }
+        else {
+            file(Timer{ deadline, id }, current + 1);
+        }
+        ++pending;
+    }
+
+    // Moves time forward to now and appends every timer whose deadline has passed to expired
+    void advance(int64_t now, std::vector<Timer>& expired) {
+        expired.insert(expired.end(), overdue.begin(), overdue.end());
+        pending -= overdue.size();
+        overdue.clear();
+        if (pending == 0) {
+            current = std::max(current, now);
+            return;
+        }
+        while (current < now) {
+            // Nothing can fire before the next boundary of the lowest occupied level, so jump to it
+            unsigned occupied = 0;
+            while (occupied + 1 < kLevels && filed[occupied] == 0) {
+                ++occupied;
+            }
+            if (occupied > 0) {
+                int64_t boundary = (current | ((int64_t(1) << (kSlotBits * occupied)) - 1)) + 1;
+                current = std::min(now, boundary) - 1;
+            }
+            ++current;
+            for (unsigned level = kLevels - 1; level > 0; --level) {
+                if ((current & ((int64_t(1) << (kSlotBits * level)) - 1)) == 0) {
+                    std::vector<Timer> cascading;
+                    cascading.swap(slots[level][(current >> (kSlotBits * level)) & (kSlots - 1)]);
+                    filed[level] -= cascading.size();
+                    for (const Timer& timer : cascading) {
+                        file(timer, current);
+                    }
+                }
+            }
+            std::vector<Timer>& due = slots[0][current & (kSlots - 1)];
+            expired.insert(expired.end(), due.begin(), due.end());
+            pending -= due.size();
+            filed[0] -= due.size();
+            due.clear();
+            if (pending == 0) {
+                current = now;
+            }
+        }
+    }
+};
+
+// The temporary grants in force, keyed by (user, resource handle): an open-addressing table that the
+// owning system updates in place while checks read it without locks. A slot's key is written once, after
+// its level, and never moves; an expired grant keeps its key with level -1. When keys fill half the slots,
+// set() refuses new keys and the owner publishes a rebuilt table sized for the live grants, so a grant
+// costs O(1) amortized and readers always see every grant made so far.
+class TemporaryGrants {
+private:
+    struct Slot {
+        std::atomic<uint64_t> key;
+        std::atomic<int> level{ -1 };
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    size_t used = 0; // slots holding a key; owner only
+    std::atomic<size_t> live{ 0 };
+
+    size_t slotOf(uint64_t key) const {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    }
+
+    int find(uint64_t key) const {
+        for (size_t i = slotOf(key);; i = (i + 1) & mask) {
+            uint64_t stored = slots[i].key.load(std::memory_order_acquire);
+            if (stored == key) {
+                return slots[i].level.load(std::memory_order_relaxed);
+            }
+            if (stored == kEmpty) {
+                return -1;
+            }
+        }
+    }
+
+public:
+    static const uint32_t kAnyResource = 0xFFFFFFFFu; // a user-wide elevation
+
+    static uint64_t keyFor(int userId, uint32_t resource) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(userId)) << 32) | resource;
+    }
+
+    // Resource handle kAnyResource - 1 is never interned, so no grant has this key
+    static const uint64_t kEmpty = ~uint64_t(1);
+
+    // capacity must be a power of two, at least twice the number of grants
+    TemporaryGrants(size_t capacity, const std::vector<std::pair<uint64_t, int>>& grants)
+        : slots(new Slot[capacity]), mask(capacity - 1) {
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].key.store(kEmpty, std::memory_order_relaxed);
+        }
+        for (const auto& grant : grants) {
+            set(grant.first, grant.second);
+        }
+    }
+
+    bool empty() const { return live.load(std::memory_order_relaxed) == 0; }
+    size_t size() const { return live.load(std::memory_order_relaxed); }
+
+    // Owner only. Returns false, changing nothing, when a new key would fill more than half the slots
+    bool set(uint64_t key, int accessLevel) {
+        size_t i = slotOf(key);
+        for (uint64_t stored; (stored = slots[i].key.load(std::memory_order_relaxed)) != kEmpty; i = (i + 1) & mask) {
+            if (stored == key) {
+                if (slots[i].level.exchange(accessLevel, std::memory_order_relaxed) < 0) {
+                    live.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+        if ((used + 1) * 2 > mask + 1) {
+            return false;
+        }
+        slots[i].level.store(accessLevel, std::memory_order_relaxed);
+        slots[i].key.store(key, std::memory_order_release);
+        ++used;
+        live.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only
+    void remove(uint64_t key) {
+        for (size_t i = slotOf(key); slots[i].key.load(std::memory_order_relaxed) != kEmpty; i = (i + 1) & mask) {
+            if (slots[i].key.load(std::memory_order_relaxed) == key) {
+                if (slots[i].level.exchange(-1, std::memory_order_relaxed) >= 0) {
+                    live.fetch_sub(1, std::memory_order_relaxed);
+                }
+                return;
+            }
+        }
+    }
+
+    // Highest level temporarily held by userId for this resource, -1 if none
+    int levelFor(int userId, int resource) const {
+        return std::max(find(keyFor(userId, static_cast<uint32_t>(resource))), find(keyFor(userId, kAnyResource)));
+    }
+};
+
+// In-memory snapshot published by an AccessControlSystem; it also resolves this process's interned
+// resource handles, so concurrent readers can check access without hashing resource names. Temporary
+// grants change independently of snapshots, so a denied check consults the owner's live grants table.
+class PublishedSnapshot : public SnapshotView {
+private:
+    std::vector<int32_t> rowByHandle;
+    std::vector<int32_t> handleByRow;
+    AuditLog* audit;
+    const VersionedPtr<TemporaryGrants>* grants;
+
+    AccessDecision decide(int userId, int handle, const SnapshotResource* resourceRecord) const {
+        const SnapshotUser* userRecord = findUser(userId);
+        if (!userRecord) {
+            return AccessDecision::UserNotFound;
+        }
+        if (!resourceRecord) {
+            return AccessDecision::ResourceNotFound;
+        }
+        if (snapshotGrants(*userRecord, *resourceRecord)) {
+            return AccessDecision::Granted;
+        }
+        if (grants && handle >= 0) {
+            auto temporary = grants->acquire();
+            if (temporary && temporary->levelFor(userId, handle) >= resourceRecord->requiredAccessLevel) {
+                return AccessDecision::Granted;
+            }
+        }
+        return AccessDecision::Denied;
+    }
+
+    AccessDecision audited(int userId, int handle, AccessDecision decision) const {
+        if (audit) {
+            audit->record(userId, handle, decision);
+        }
+        return decision;
+    }
+
+public:
+    PublishedSnapshot(std::vector<char> image, std::vector<int32_t> rowByHandle, AuditLog* audit, const VersionedPtr<TemporaryGrants>* grants)
+        : SnapshotView(std::move(image)), rowByHandle(std::move(rowByHandle)), handleByRow(resourceCount(), -1), audit(audit), grants(grants) {
+        for (size_t handle = 0; handle < this->rowByHandle.size(); ++handle) {
+            if (this->rowByHandle[handle] >= 0) {
+                handleByRow[static_cast<size_t>(this->rowByHandle[handle])] = static_cast<int32_t>(handle);
+            }
+        }
+    }
+
+    AccessDecision decideAccess(int userId, int resource) const {
+        bool known = resource >= 0 && static_cast<size_t>(resource) < rowByHandle.size() && rowByHandle[resource] >= 0;
+        return audited(userId, resource, decide(userId, resource, known ? &this->resource(rowByHandle[resource]) : nullptr));
+    }
+
+    AccessDecision decideAccess(int userId, std::string_view resourceName) const {
+        const SnapshotResource* resourceRecord = findResource(resourceName);
+        int handle = resourceRecord ? handleByRow[static_cast<size_t>(resourceRecord - &resource(0))] : -1;
+        return audited(userId, handle, decide(userId, handle, resourceRecord));
+    }
+};
+
+// Parallel loader for the text format written by AccessControlSystem::saveToFile. The file is mapped and cut
+// into byte ranges; newlines are counted per range in parallel, which gives every range the number of its
+// first line and therefore its first record boundary (user records are 5 lines, resources 2). Ranges are
+// then parsed concurrently and the per-range results concatenated in file order.
+template<typename T>
+class ParallelTextLoader {
+private:
+    struct Chunk {
+        size_t begin = 0;
+        size_t end = 0;
+        size_t newlines = 0;
+        std::vector<std::unique_ptr<User>> users;
+        std::vector<T> resources;
+        size_t errorLine = 0; // 1-based, 0 = no error
+        std::string error;
+    };
+
+    struct ParseError {
+        size_t line;
+        std::string message;
+    };
+
+    const char* data;
+    size_t size;
+    size_t userCount = 0;
+    size_t resourceCount = 0;
+
+    // Reads the line starting at pos (without '\n' or a trailing '\r') and advances pos past it
+    bool readLine(size_t& pos, std::string_view& line) const {
+        if (pos >= size) {
+            return false;
+        }
+        const void* newline = std::memchr(data + pos, '\n', size - pos);
+        size_t end = newline ? static_cast<size_t>(static_cast<const char*>(newline) - data) : size;
+        line = std::string_view(data + pos, end - pos);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        pos = end + 1;
+        return true;
+    }
+
+    template<typename Int>
+    static bool parseNumber(std::string_view text, Int& value) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size() && !text.empty();
+    }
+
+    // line is the 0-based index of the line at pos
+    std::string_view field(size_t& pos, size_t& line) const {
+        std::string_view text;
+        if (!readLine(pos, text)) {
+            throw ParseError{ line + 1, "unexpected end of file" };
+        }
+        ++line;
+        return text;
+    }
+
+    template<typename Int>
+    Int numberField(size_t& pos, size_t& line, const char* what) const {
+        std::string_view text = field(pos, line);
+        Int value;
+        if (!parseNumber(text, value)) {
+            throw ParseError{ line, std::string("invalid ") + what + " '" + std::string(text) + "'" };
+        }
+        return value;
+    }
+
+    template<typename Build>
+    void buildRecord(size_t firstLine, Build build) const {
+        try {
+            build();
+        }
+        catch (const std::invalid_argument& e) {
+            throw ParseError{ firstLine + 1, e.what() };
+        }
+    }
+
+    void parseChunk(Chunk& chunk, size_t firstLineIndex) const {
+        const size_t userLines = userCount * 5;
+        const size_t resourceBegin = userLines + 2;
+        const size_t resourceEnd = resourceBegin + resourceCount * 2;
+
+        size_t pos = chunk.begin;
+        size_t line = firstLineIndex;
+        if (pos > 0 && data[pos - 1] != '\n') {
+            std::string_view partial;
+            readLine(pos, partial);
+            ++line;
+        }
+
+        try {
+            while (pos < chunk.end && pos < size) {
+                size_t recordLine = line;
+                if (line >= 1 && line <= userLines && (line - 1) % 5 == 0) {
+                    std::string_view typeName = field(pos, line);
+                    UserType type;
+                    if (!parseUserType(typeName, type)) {
+                        throw ParseError{ line, "unknown user type '" + std::string(typeName) + "'" };
+                    }
+                    std::string_view name = field(pos, line);
+                    int id = numberField<int>(pos, line, "user id");
+                    int accessLevel = numberField<int>(pos, line, "access level");
+                    std::string_view attribute = field(pos, line);
+                    buildRecord(recordLine, [&] {
+                        chunk.users.push_back(makeUser(type, std::string(name), id, accessLevel, std::string(attribute)));
+                    });
+                }
+                else if (line >= resourceBegin && line < resourceEnd && (line - resourceBegin) % 2 == 0) {
+                    std::string_view name = field(pos, line);
+                    int requiredAccessLevel = numberField<int>(pos, line, "required access level");
+                    buildRecord(recordLine, [&] {
+                        if constexpr (std::is_constructible_v<T, std::string_view, int>) {
+                            chunk.resources.push_back(T(name, requiredAccessLevel));
+                        }
+                        else {
+                            chunk.resources.push_back(T(std::string(name), requiredAccessLevel));
+                        }
+                    });
+                }
+                else {
+                    std::string_view skipped;
+                    readLine(pos, skipped);
+                    ++line;
+                }
+            }
+        }
+        catch (const ParseError& e) {
+            chunk.errorLine = e.line;
+            chunk.error = e.message;
+        }
+    }
+
+    template<typename Fn>
+    static void runTasks(size_t taskCount, Fn fn) {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < taskCount; ++i) {
+            workers.emplace_back(fn, i);
+        }
+        if (taskCount > 0) {
+            fn(size_t(0));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    static std::runtime_error lineError(size_t line, const std::string& message) {
+        return std::runtime_error("line " + std::to_string(line) + ": " + message);
+    }
+
+    std::string usersFoundMessage(size_t found) const {
+        return "the file declares " + std::to_string(userCount) + " users but has " + std::to_string(found);
+    }
+
+public:
+    ParallelTextLoader(const char* data, size_t size) : data(data), size(size) {}
+
+    void load(std::vector<std::unique_ptr<User>>& users, std::vector<T>& resources, unsigned threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        const size_t minChunkBytes = 1 << 20;
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount * 4, size / minChunkBytes));
+        std::vector<Chunk> chunks(chunkCount);
+        for (size_t i = 0; i < chunkCount; ++i) {
+            chunks[i].begin = size * i / chunkCount;
+            chunks[i].end = size * (i + 1) / chunkCount;
+        }
+
+        runTasks(std::min<size_t>(chunkCount, threadCount), [&](size_t worker) {
+            for (size_t i = worker; i < chunkCount; i += std::min<size_t>(chunkCount, threadCount)) {
+                chunks[i].newlines = static_cast<size_t>(std::count(data + chunks[i].begin, data + chunks[i].end, '\n'));
+            }
+        });
+
+        // Line numbers at chunk starts, then the two count lines (user count first, resource count after the users)
+        std::vector<size_t> firstLine(chunkCount);
+        for (size_t i = 0, lines = 0; i < chunkCount; ++i) {
+            firstLine[i] = lines;
+            lines += chunks[i].newlines;
+        }
+
+        size_t pos = 0;
+        std::string_view text;
+        if (!readLine(pos, text) || !parseNumber(text, userCount)) {
+            throw lineError(1, "invalid user count");
+        }
+        const size_t resourceCountLine = userCount * 5 + 1;
+        // Last chunk that starts before the resource count line, so the scan never starts inside that line
+        size_t chunk = static_cast<size_t>(std::lower_bound(firstLine.begin(), firstLine.end(), resourceCountLine) - firstLine.begin()) - 1;
+        pos = chunks[chunk].begin;
+        size_t line = firstLine[chunk];
+        while (line < resourceCountLine && readLine(pos, text)) {
+            ++line;
+        }
+        if (line != resourceCountLine) {
+            throw lineError(line, usersFoundMessage(line > 0 ? (line - 1) / 5 : 0));
+        }
+        if (!readLine(pos, text) || !parseNumber(text, resourceCount)) {
+            throw lineError(resourceCountLine + 1, pos > size ? "unexpected end of file" : "invalid resource count");
+        }
+
+        runTasks(std::min<size_t>(chunkCount, threadCount), [&](size_t worker) {
+            for (size_t i = worker; i < chunkCount; i += std::min<size_t>(chunkCount, threadCount)) {
+                parseChunk(chunks[i], firstLine[i]);
+            }
+        });
+
+        for (const auto& parsed : chunks) {
+            if (parsed.errorLine) {
+                throw lineError(parsed.errorLine, parsed.error);
+            }
+        }
+
+        users.clear();
+        resources.clear();
+        users.reserve(userCount);
+        resources.reserve(resourceCount);
+        for (auto& parsed : chunks) {
+            std::move(parsed.users.begin(), parsed.users.end(), std::back_inserter(users));
+            std::move(parsed.resources.begin(), parsed.resources.end(), std::back_inserter(resources));
+        }
+        if (users.size() != userCount) {
+            throw lineError(2 + users.size() * 5, usersFoundMessage(users.size()));
+        }
+        if (resources.size() != resourceCount) {
+            throw lineError(userCount * 5 + 3 + resources.size() * 2, "unexpected end of file");
+        }
+    }
+};
+
+// Storage is the user storage policy: PointerUserStore or FlatUserStore
+template<typename T, typename Storage = PointerUserStore>
+class AccessControlSystem {
+private:
+    Storage users;
+    std::vector<T> resources;
+    FlatHashMap<int, size_t> userIndex;
+    std::vector<int32_t> resourceRows; // interned name handle -> row in resources, -1 if absent
+    UserColumns userColumns;
+    PermissionRegistry permissions;
+    OrderedIndex usersById;
+    OrderedIndex usersByAccessLevel;
+    OrderedIndex resourcesByLevel; // requiredAccessLevel -> row in resources
+    std::vector<size_t> grantedResourceRows; // rows whose grant mask is non-zero
+    ResourceTree resourceTree;
+    UserOrder displayOrder = UserOrder::Insertion;
+    std::unique_ptr<ChangeJournal> journal;
+    std::future<void> compaction;
+    VersionedPtr<PublishedSnapshot> published;
+    AuditLog* audit = nullptr;
+
+    struct TimedGrant {
+        int accessLevel;
+        int64_t deadline;
+    };
+    std::map<uint64_t, TimedGrant> timedGrants; // writer-owned; the grants in activeGrants, with deadlines
+    TimerWheel grantExpiry{ grantTick(std::chrono::system_clock::now()) };
+    VersionedPtr<TemporaryGrants> activeGrants;
+    TemporaryGrants* grantTable = nullptr; // the published table, which the writer updates in place
+
+    void record(JournalRecord& change) {
+        if (journal) {
+            journal->append(change.finish());
+        }
+    }
+
+    void replayJournal(const std::string& filename) {
+        MappedFile file(filename);
+        JournalReader reader(file.data(), file.size());
+        JournalReader change(nullptr, 0);
+        while (reader.next(change)) {
+            switch (change.op()) {
+            case JournalOp::AddUser: {
+                UserType type = static_cast<UserType>(change.getInt());
+                std::string name = change.getString();
+                int id = change.getInt();
+                int accessLevel = change.getInt();
+                std::string attribute = change.getString();
+                // A retired journal may already be folded into the snapshot; adds are then skipped
+                if (!userIndex.find(id)) {
+                    users.push_back(makeUser(type, name, id, accessLevel, attribute));
+                    indexLastUser();
+                }
+                break;
+            }
+            case JournalOp::SetAccessLevel: {
+                int id = change.getInt();
+                setUserAccessLevel(id, change.getInt());
+                break;
+            }
+            case JournalOp::SetName: {
+                int id = change.getInt();
+                setUserName(id, change.getString());
+                break;
+            }
+            case JournalOp::AddResource: {
+                std::string name = change.getString();
+                int requiredAccessLevel = change.getInt();
+                if (resourceHandle(name) < 0) {
+                    addResource(T(name, requiredAccessLevel));
+                }
+                break;
+            }
+            case JournalOp::SetRequiredAccessLevel: {
+                std::string name = change.getString();
+                setResourceRequiredAccessLevel(name, change.getInt());
+                break;
+            }
+            case JournalOp::GrantAccess: {
+                std::string name = change.getString();
+                PermissionKind kind = static_cast<PermissionKind>(change.getInt());
+                // Granting twice is harmless, so grants already in the snapshot are simply applied again
+                grantAccess(name, kind, change.getString());
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown journal record in " + filename);
+            }
+        }
+    }
+
+    static std::string retiredJournalName(const std::string& journalFile) {
+        return journalFile + ".1";
+    }
+
+    // Re-derives the id index, the column mirror and the ordered indexes after users has been replaced
+    void rebuildUserIndex() {
+        userIndex.clear();
+        userIndex.reserve(users.size());
+        userColumns.clear();
+        userColumns.reserve(users.size());
+        usersById.clear();
+        usersById.reserve(users.size());
+        usersByAccessLevel.clear();
+        usersByAccessLevel.reserve(users.size());
+        for (size_t i = 0; i < users.size(); ++i) {
+            User& user = users[i];
+            if (!userIndex.insert(user.getId(), i)) {
+                throw std::runtime_error("Duplicate user ID: " + std::to_string(user.getId()));
+            }
+            user.setPermissionMask(permissions.maskFor(user));
+            userColumns.push_back(user);
+            usersById.insert(user.getId(), i);
+            usersByAccessLevel.insert(user.getAccessLevel(), i);
+        }
+    }
+
+    // Indexes the user just appended to users; a duplicate id is taken back out and rejected
+    void indexLastUser() {
+        size_t row = users.size() - 1;
+        User& user = users[row];
+        if (!userIndex.insert(user.getId(), row)) {
+            int id = user.getId();
+            users.pop_back();
+            throw std::invalid_argument("User with ID " + std::to_string(id) + " already exists");
+        }
+        user.setPermissionMask(permissions.maskFor(user));
+        userColumns.push_back(user);
+        usersById.insert(user.getId(), row);
+        usersByAccessLevel.insert(user.getAccessLevel(), row);
+    }
+
+    std::vector<User*> collectUsers(std::pair<const OrderedIndex::Entry*, const OrderedIndex::Entry*> range) const {
+        std::vector<User*> result;
+        result.reserve(static_cast<size_t>(range.second - range.first));
+        for (auto entry = range.first; entry != range.second; ++entry) {
+            result.push_back(&users[entry->row]);
+        }
+        return result;
+    }
+
+    void rebuildResourceIndex() {
+        resourceRows.clear();
+        resourcesByLevel.clear();
+        resourcesByLevel.reserve(resources.size());
+        grantedResourceRows.clear();
+        for (size_t i = 0; i < resources.size(); ++i) {
+            if (!indexResource(resources[i].getHandle(), i)) {
+                throw std::runtime_error("Duplicate resource name: " + std::string(resources[i].getName()));
+            }
+            resourcesByLevel.insert(resources[i].getRequiredAccessLevel(), i);
+            if (resources[i].getGrantMask()) {
+                grantedResourceRows.push_back(i);
+            }
+        }
+    }
+
+    bool indexResource(uint32_t handle, size_t row) {
+        if (handle >= resourceRows.size()) {
+            resourceRows.resize(handle + 1, -1);
+        }
+        if (resourceRows[handle] >= 0) {
+            return false;
+        }
+        resourceRows[handle] = static_cast<int32_t>(row);
+        return true;
+    }
+
+    // Grant deadlines are whole seconds, rounded up so a grant never ends early
+    static int64_t grantTick(std::chrono::system_clock::time_point time) {
+        return std::chrono::ceil<std::chrono::seconds>(time.time_since_epoch()).count();
+    }
+
+    void addTimedGrant(int userId, uint32_t resource, int accessLevel, std::chrono::system_clock::time_point expiresAt) {
+        if (!userIndex.find(userId)) {
+            throw std::runtime_error("User not found");
+        }
+        if (accessLevel < 0) {
+            throw std::invalid_argument("Access level cannot be negative");
+        }
+        uint64_t key = TemporaryGrants::keyFor(userId, resource);
+        int64_t deadline = grantTick(expiresAt);
+        timedGrants[key] = TimedGrant{ accessLevel, deadline };
+        // Replacing a grant leaves its old timer in the wheel; it no longer matches the deadline and is ignored
+        grantExpiry.schedule(deadline, key);
+        if (!grantTable->set(key, accessLevel)) {
+            publishGrants();
+        }
+    }
+
+    // Publishes a fresh table holding every live grant with room for as many again as it has slots in use
+    void publishGrants() {
+        size_t capacity = 64;
+        while (capacity < timedGrants.size() * 4) {
+            capacity *= 2;
+        }
+        std::vector<std::pair<uint64_t, int>> grants;
+        grants.reserve(timedGrants.size());
+        for (const auto& grant : timedGrants) {
+            grants.emplace_back(grant.first, grant.second.accessLevel);
+        }
+        grantTable = &activeGrants.publish(capacity, grants);
+    }
+
+    const T* resourceFor(int handle) const {
+        if (handle < 0 || static_cast<size_t>(handle) >= resourceRows.size() || resourceRows[handle] < 0) {
+            return nullptr;
+        }
+        return &resources[resourceRows[handle]];
+    }
+
+public:
+    using SnapshotRef = VersionedPtr<PublishedSnapshot>::Ref;
+
+    AccessControlSystem() {
+        publishGrants();
+        publish();
+    }
+
+    template<typename U, typename... Args>
+    void addUser(Args&&... args) {
+        users.template emplace<U>(std::forward<Args>(args)...);
+        indexLastUser();
+        if (journal) {
+            const User& user = users[users.size() - 1];
+            JournalRecord change(JournalOp::AddUser);
+            change.putInt(static_cast<int32_t>(user.getType())).putString(user.getName())
+                .putInt(user.getId()).putInt(user.getAccessLevel()).putString(userAttribute(user));
+            record(change);
+        }
+    }
+
+    // Prefer these over the setters of a found user so the column mirror and the journal stay in sync
+    void setUserAccessLevel(int userId, int newAccessLevel) {
+        const size_t* index = userIndex.find(userId);
+        if (!index) {
+            throw std::runtime_error("User not found");
+        }
+        int oldAccessLevel = users[*index].getAccessLevel();
+        users[*index].setAccessLevel(newAccessLevel);
+        userColumns.setAccessLevel(*index, newAccessLevel);
+        usersByAccessLevel.erase(oldAccessLevel, *index);
+        usersByAccessLevel.insert(newAccessLevel, *index);
+        JournalRecord change(JournalOp::SetAccessLevel);
+        change.putInt(userId).putInt(newAccessLevel);
+        record(change);
+    }
+
+    void setUserName(int userId, const std::string& newName) {
+        const size_t* index = userIndex.find(userId);
+        if (!index) {
+            throw std::runtime_error("User not found");
+        }
+        users[*index].setName(newName);
+        JournalRecord change(JournalOp::SetName);
+        change.putInt(userId).putString(newName);
+        record(change);
+    }
+
+    void addResource(const T& resource) {
+        size_t row = resources.size();
+        if (!indexResource(resource.getHandle(), row)) {
+            throw std::invalid_argument("Resource '" + std::string(resource.getName()) + "' already exists");
+        }
+        resources.push_back(resource);
+        resourcesByLevel.insert(resource.getRequiredAccessLevel(), row);
+        if (resource.getGrantMask()) {
+            grantedResourceRows.push_back(row);
+        }
+        JournalRecord change(JournalOp::AddResource);
+        change.putString(resource.getName()).putInt(resource.getRequiredAccessLevel());
+        record(change);
+    }
+
+    // Lets every user whose group/department/position equals value into the resource, whatever their level.
+    // Grants are kept in snapshots and the journal but not in the text files of saveToFile.
+    // At most PermissionRegistry::kMaxGrants (32) distinct attributes can be granted: a grant that would need
+    // a 33rd throws std::runtime_error and changes nothing, while further grants of known attributes still work.
+    void grantAccess(const std::string& resourceName, PermissionKind kind, const std::string& value) {
+        int handle = resourceHandle(resourceName);
+        if (handle < 0) {
+            throw std::runtime_error("Resource not found");
+        }
+        bool allocated;
+        uint32_t bit = permissions.bitFor(kind, value, allocated);
+        if (allocated) {
+            for (size_t row = 0; row < users.size(); ++row) {
+                uint32_t mask = permissions.maskFor(users[row]);
+                users[row].setPermissionMask(mask);
+                userColumns.setPermissionMask(row, mask);
+            }
+        }
+        T& resource = resources[resourceRows[handle]];
+        if (!resource.getGrantMask()) {
+            grantedResourceRows.push_back(static_cast<size_t>(resourceRows[handle]));
+        }
+        resource.addGrant(bit);
+        JournalRecord change(JournalOp::GrantAccess);
+        change.putString(resourceName).putInt(static_cast<int>(kind)).putString(value);
+        record(change);
+    }
+
+    // Temporary access: until expiresAt the user counts as holding accessLevel for this resource
+    // (grantTemporaryAccess) or for every resource (elevateTemporarily). A new grant for the same user and
+    // resource replaces the old one. Grants are honoured by decideAccess, the batch check, published snapshots
+    // and accessibleResources until expireTemporaryGrants retires them; unlike permission grants they are not persisted.
+    void grantTemporaryAccess(int userId, const std::string& resourceName, int accessLevel, std::chrono::system_clock::time_point expiresAt) {
+        int handle = resourceHandle(resourceName);
+        if (handle < 0) {
+            throw std::runtime_error("Resource not found");
+        }
+        addTimedGrant(userId, static_cast<uint32_t>(handle), accessLevel, expiresAt);
+    }
+
+    void elevateTemporarily(int userId, int accessLevel, std::chrono::system_clock::time_point expiresAt) {
+        addTimedGrant(userId, TemporaryGrants::kAnyResource, accessLevel, expiresAt);
+    }
+
+    // Call periodically from the writer thread. Removes the grants that ran out by now from the live
+    // table; a concurrent check sees each grant either still in force or gone.
+    size_t expireTemporaryGrants(std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) {
+        std::vector<TimerWheel::Timer> fired;
+        grantExpiry.advance(std::chrono::floor<std::chrono::seconds>(now.time_since_epoch()).count(), fired);
+        size_t expired = 0;
+        for (const TimerWheel::Timer& timer : fired) {
+            auto grant = timedGrants.find(timer.id);
+            if (grant != timedGrants.end() && grant->second.deadline == timer.deadline) {
+                timedGrants.erase(grant);
+                grantTable->remove(timer.id);
+                ++expired;
+            }
+        }
+        return expired;
+    }
+
+    size_t temporaryGrantCount() const {
+        return timedGrants.size();
+    }
+
+    // Hierarchical resources: a path such as "Main/3/Laboratory 202" becomes an ordinary resource named by
+    // the full path, whose required level is the effective level resolved through the tree. The tree itself
+    // is runtime configuration; the resolved levels are saved and journaled like any other resource level.
+    void addResourcePath(const std::string& path, int requiredAccessLevel = -1) {
+        if (resourceHandle(path) >= 0) {
+            throw std::invalid_argument("Resource '" + path + "' already exists");
+        }
+        if (requiredAccessLevel >= 0) {
+            // The path may already lead to resources below it, which inherit the new level
+            setPathLevel(path, requiredAccessLevel);
+        }
+        addResource(T(path, resourceTree.addResource(path)));
+    }
+
+    // Sets the level of a building, floor or room (-1 = inherit from the parent again) and updates
+    // the resources below it that inherit the change
+    void setPathLevel(const std::string& path, int requiredAccessLevel) {
+        resourceTree.setLevel(path, requiredAccessLevel, [this](const std::string& resourcePath, int level) {
+            // A load may have replaced the resource table since the path was added
+            if (resourceHandle(resourcePath) >= 0) {
+                setResourceRequiredAccessLevel(resourcePath, level);
+            }
+        });
+    }
+
+    int effectiveLevel(const std::string& path) const {
+        return resourceTree.effectiveLevel(path);
+    }
+
+    void setResourceRequiredAccessLevel(const std::string& resourceName, int newLevel) {
+        int handle = resourceHandle(resourceName);
+        if (handle < 0) {
+            throw std::runtime_error("Resource not found");
+        }
+        size_t row = static_cast<size_t>(resourceRows[handle]);
+        int oldLevel = resources[row].getRequiredAccessLevel();
+        resources[row].setRequiredAccessLevel(newLevel);
+        resourcesByLevel.erase(oldLevel, row);
+        resourcesByLevel.insert(newLevel, row);
+        JournalRecord change(JournalOp::SetRequiredAccessLevel);
+        change.putString(resourceName).putInt(newLevel);
+        record(change);
+    }
+
+    // From now on every mutation is appended to the journal; it becomes durable within one commit interval
+    void enableJournal(const std::string& journalFile) {
+        waitForCompaction();
+        journal = std::make_unique<ChangeJournal>(journalFile);
+    }
+
+    // Blocks until every change made so far is on stable storage
+    void syncJournal() {
+        if (journal) {
+            journal->sync();
+        }
+    }
+
+    // Loads the last snapshot (if any), replays the retired and the active journal on top of it,
+    // checkpoints the result into a fresh snapshot and continues journaling into journalFile
+    void recover(const std::string& snapshotFile, const std::string& journalFile) {
+        waitForCompaction();
+        journal.reset();
+        if (fileExists(snapshotFile)) {
+            loadSnapshot(snapshotFile);
+        }
+        else {
+            users.clear();
+            resources.clear();
+            permissions.clear();
+            rebuildUserIndex();
+            rebuildResourceIndex();
+        }
+
+        std::string retired = retiredJournalName(journalFile);
+        if (fileExists(retired)) {
+            replayJournal(retired);
+        }
+        if (fileExists(journalFile)) {
+            replayJournal(journalFile);
+        }
+
+        std::vector<char> image = buildSnapshotImage();
+        writeFileDurably(snapshotFile + ".tmp", image.data(), image.size());
+        replaceFile(snapshotFile + ".tmp", snapshotFile);
+        std::remove(retired.c_str());
+        writeFileDurably(journalFile, nullptr, 0);
+        journal = std::make_unique<ChangeJournal>(journalFile);
+    }
+
+    // Folds the journal into a fresh snapshot. The in-memory image is taken synchronously (a consistent
+    // cut), the journal switches to a new file, and writing the snapshot happens on a background thread.
+    void compactJournal(const std::string& snapshotFile) {
+        if (!journal) {
+            throw std::runtime_error("Journal is not enabled");
+        }
+        waitForCompaction();
+
+        auto image = std::make_shared<std::vector<char>>(buildSnapshotImage());
+        std::string retired = retiredJournalName(journal->getFilename());
+        journal->rotate(retired);
+
+        compaction = std::async(std::launch::async, [image, snapshotFile, retired] {
+            writeFileDurably(snapshotFile + ".tmp", image->data(), image->size());
+            replaceFile(snapshotFile + ".tmp", snapshotFile);
+            std::remove(retired.c_str());
+        });
+    }
+
+    void waitForCompaction() {
+        if (compaction.valid()) {
+            compaction.get();
+        }
+    }
+
+    // Resolves a name to its handle (T::handleOf) once, so hot paths can pass the handle instead of the string.
+    // Returns -1 if this system has no resource with this name.
+    int resourceHandle(std::string_view resourceName) const {
+        int handle = T::handleOf(resourceName);
+        return resourceFor(handle) ? handle : -1;
+    }
+
+    AccessDecision decideAccess(int userId, int resource) const noexcept {
+        AccessDecision decision;
+        const size_t* userPos = userIndex.find(userId);
+        const T* target = resourceFor(resource);
+        if (!userPos) {
+            decision = AccessDecision::UserNotFound;
+        }
+        else if (!target) {
+            decision = AccessDecision::ResourceNotFound;
+        }
+        else if (target->checkAccess(users[*userPos])) {
+            decision = AccessDecision::Granted;
+        }
+        else {
+            auto temporary = activeGrants.acquire();
+            decision = temporary->levelFor(userId, resource) >= target->getRequiredAccessLevel()
+                ? AccessDecision::Granted : AccessDecision::Denied;
+        }
+        if (audit) {
+            audit->record(userId, resource, decision);
+        }
+        return decision;
+    }
+
+    // Every decision made through this system or its published snapshots is recorded; snapshots
+    // already held by readers keep their previous log. Pass nullptr to stop auditing.
+    void setAuditLog(AuditLog* log) {
+        audit = log;
+        publish();
+    }
+
+    // Writes one decision per request into decisions; never allocates (except worker threads) or throws on misses.
+    // threadCount == 0 uses all hardware threads, small batches always run on the calling thread.
+    void checkAccessBatch(const AccessRequest* requests, size_t count, AccessDecision* decisions, unsigned threadCount = 1) const {
+        parallelFor(count, threadCount, [this, requests, decisions](size_t begin, size_t end) {
+            auto temporary = activeGrants.acquire();
+            const TemporaryGrants* extra = temporary && !temporary->empty() ? temporary.get() : nullptr;
+            // Lookups gather each block's operands into small arrays; the access rule then runs as one
+            // branch-free loop over the block, which the compiler vectorizes
+            const size_t kBlock = 64;
+            int levels[kBlock], required[kBlock];
+            uint32_t masks[kBlock], grants[kBlock];
+            uint8_t granted[kBlock];
+            for (size_t blockStart = begin; blockStart < end; blockStart += kBlock) {
+                size_t n = std::min(kBlock, end - blockStart);
+                for (size_t k = 0; k < n; ++k) {
+                    const AccessRequest& request = requests[blockStart + k];
+                    const size_t* row = userIndex.find(request.userId);
+                    const T* target = resourceFor(request.resource);
+                    decisions[blockStart + k] = !row ? AccessDecision::UserNotFound
+                        : !target ? AccessDecision::ResourceNotFound : AccessDecision::Denied;
+                    levels[k] = row ? userColumns.accessLevel(*row) : 0;
+                    masks[k] = row ? userColumns.permissionMask(*row) : 0;
+                    required[k] = target ? target->getRequiredAccessLevel() : 0;
+                    grants[k] = target ? target->getGrantMask() : 0;
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    granted[k] = static_cast<uint8_t>((levels[k] >= required[k]) | ((masks[k] & grants[k]) != 0));
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    if (decisions[blockStart + k] == AccessDecision::Denied && (granted[k]
+                        || (extra && extra->levelFor(requests[blockStart + k].userId, requests[blockStart + k].resource) >= required[k]))) {
+                        decisions[blockStart + k] = AccessDecision::Granted;
+                    }
+                    if (audit) {
+                        audit->record(requests[blockStart + k].userId, requests[blockStart + k].resource, decisions[blockStart + k]);
+                    }
+                }
+            }
+        });
+    }
+
+    std::vector<AccessDecision> checkAccessBatch(const std::vector<AccessRequest>& requests, unsigned threadCount = 1) const {
+        std::vector<AccessDecision> decisions(requests.size());
+        checkAccessBatch(requests.data(), requests.size(), decisions.data(), threadCount);
+        return decisions;
+    }
+
+    std::string checkAccess(int userId, const std::string& resourceName) const {
+        int resource = resourceHandle(resourceName);
+        AccessDecision decision = decideAccess(userId, resource);
+
+        if (decision == AccessDecision::UserNotFound) {
+            throw std::runtime_error("User not found");
+        }
+        if (decision == AccessDecision::ResourceNotFound) {
+            throw std::runtime_error("Resource not found");
+        }
+
+        return findUserById(userId)->getName() + " is trying to access '" + std::string(resourceFor(resource)->getName()) + "': "
+            + (decision == AccessDecision::Granted ? "Access granted" : "Access denied");
+    }
+
+    const UserColumns& getUserColumns() const { return userColumns; }
+
+    size_t countWithAccess(int accessLevel) const {
+        return userColumns.countWithAccess(accessLevel);
+    }
+
+    std::vector<int> whoCanAccess(int resource) const {
+        const T* target = resourceFor(resource);
+        if (!target) {
+            throw std::runtime_error("Resource not found");
+        }
+        return userColumns.idsWithAccess(target->getRequiredAccessLevel(), target->getGrantMask());
+    }
+
+    std::vector<int> whoCanAccess(const std::string& resourceName) const {
+        return whoCanAccess(resourceHandle(resourceName));
+    }
+
+    // Resources whose required level is at most accessLevel, by binary search on the level index
+    size_t countAccessible(int accessLevel) const {
+        auto range = resourcesByLevel.range(std::numeric_limits<int>::min(), accessLevel);
+        return static_cast<size_t>(range.second - range.first);
+    }
+
+    // Everything the user may enter: the level-ordered slice up to their level (raised by a temporary
+    // elevation), then the resources above it that they reach through a grant or a temporary grant
+    std::vector<const T*> accessibleResources(int userId) const {
+        const User* user = findUserById(userId);
+        if (!user) {
+            throw std::runtime_error("User not found");
+        }
+        // A user's temporary grants are adjacent in timedGrants, the user-wide elevation last
+        auto first = timedGrants.lower_bound(TemporaryGrants::keyFor(userId, 0));
+        auto last = timedGrants.upper_bound(TemporaryGrants::keyFor(userId, TemporaryGrants::kAnyResource));
+        int level = user->getAccessLevel();
+        if (last != first && std::prev(last)->first == TemporaryGrants::keyFor(userId, TemporaryGrants::kAnyResource)) {
+            level = std::max(level, std::prev(last)->second.accessLevel);
+            --last;
+        }
+        auto range = resourcesByLevel.range(std::numeric_limits<int>::min(), level);
+        std::vector<const T*> result;
+        result.reserve(static_cast<size_t>(range.second - range.first));
+        for (auto entry = range.first; entry != range.second; ++entry) {
+            result.push_back(&resources[entry->row]);
+        }
+        for (size_t row : grantedResourceRows) {
+            const T& resource = resources[row];
+            if (resource.getRequiredAccessLevel() > level && (resource.getGrantMask() & user->getPermissionMask())) {
+                result.push_back(&resource);
+            }
+        }
+        for (auto grant = first; grant != last; ++grant) {
+            const T* resource = resourceFor(static_cast<int>(grant->first & 0xFFFFFFFFu));
+            if (resource && resource->getRequiredAccessLevel() > level && grant->second.accessLevel >= resource->getRequiredAccessLevel()
+                && !(resource->getGrantMask() & user->getPermissionMask())) {
+                result.push_back(resource);
+            }
+        }
+        return result;
+    }
+
+    std::vector<User*> findUsersByName(const std::string& name) const {
+        std::vector<User*> result;
+        for (size_t row = 0; row < users.size(); ++row) {
+            if (users[row].getName() == name) {
+                result.push_back(&users[row]);
+            }
+        }
+        return result;
+    }
+
+    User* findUserById(int id) const {
+        const size_t* index = userIndex.find(id);
+        return index ? &users[*index] : nullptr;
+    }
+
+    // Inclusive ranges, answered from the ordered indexes in key order
+    std::vector<User*> findUsersByIdRange(int minId, int maxId) const {
+        return collectUsers(usersById.range(minId, maxId));
+    }
+
+    std::vector<User*> findUsersByAccessLevelRange(int minLevel, int maxLevel) const {
+        return collectUsers(usersByAccessLevel.range(minLevel, maxLevel));
+    }
+
+    template<typename Fn>
+    void forEachUser(UserOrder order, Fn fn) const {
+        if (order == UserOrder::Insertion) {
+            users.forEach(fn);
+            return;
+        }
+        const OrderedIndex& index = order == UserOrder::ById ? usersById : usersByAccessLevel;
+        for (const auto& entry : index) {
+            fn(users[entry.row]);
+        }
+    }
+
+    // The sorts only pick which ordered index displayAllUsers walks; the user table keeps insertion order
+    void sortUsersByAccessLevel() {
+        displayOrder = UserOrder::ByAccessLevel;
+    }
+
+    void sortUsersById() {
+        displayOrder = UserOrder::ById;
+    }
+
+    void displayAllUsers() const {
+        forEachUser(displayOrder, [](const User& user) { user.displayInfo(); });
+    }
+
+    void displayAllResources() const {
+        for (const auto& resource : resources) {
+            std::cout << "Resource: " << resource.getName()
+                << ", Required access level: "
+                << resource.getRequiredAccessLevel() << std::endl;
+        }
+    }
+
+    void saveToFile(const std::string& filename) const {
+        std::ofstream out(filename);
+        if (!out) {
+            throw std::runtime_error("Failed to open file for writing");
+        }
+
+        users.saveToFile(out);
+
+        out << resources.size() << '\n';
+        for (const auto& resource : resources) {
+            resource.saveToFile(out);
+        }
+    }
+
+    void loadFromFile(const std::string& filename) {
+        std::ifstream in(filename);
+        if (!in) {
+            throw std::runtime_error("Failed to open file for reading");
+        }
+
+        users.clear();
+        resources.clear();
+        userIndex.clear();
+        resourceRows.clear();
+
+        size_t userCount;
+        in >> userCount;
+        in.ignore();
+
+        // Fields are read first and the objects constructed from them, so the constructors' validation applies
+        for (size_t i = 0; i < userCount; ++i) {
+            std::string typeName, name, attribute;
+            int id, accessLevel;
+            std::getline(in, typeName);
+            std::getline(in, name);
+            in >> id >> accessLevel;
+            in.ignore();
+            std::getline(in, attribute);
+
+            UserType type;
+            if (!in || !parseUserType(typeName, type)) {
+                throw std::runtime_error("Unknown user type in file");
+            }
+            users.push_back(makeUser(type, name, id, accessLevel, attribute));
+        }
+
+        size_t resourceCount;
+        in >> resourceCount;
+        in.ignore();
+
+        for (size_t i = 0; i < resourceCount; ++i) {
+            std::string name;
+            int requiredAccessLevel;
+            std::getline(in, name);
+            in >> requiredAccessLevel;
+            in.ignore();
+            if (!in) {
+                throw std::runtime_error("Unexpected end of file");
+            }
+            resources.push_back(T(name, requiredAccessLevel));
+        }
+
+        rebuildUserIndex();
+        rebuildResourceIndex();
+    }
+
+    // Produces the same users and resources as loadFromFile, parsing the file on threadCount threads
+    // (0 = all hardware threads); errors name the offending line
+    void loadFromFileParallel(const std::string& filename, unsigned threadCount = 0) {
+        MappedFile file(filename);
+        std::vector<std::unique_ptr<User>> loadedUsers;
+        std::vector<T> loadedResources;
+        ParallelTextLoader<T>(file.data(), file.size()).load(loadedUsers, loadedResources, threadCount);
+
+        users.assign(std::move(loadedUsers));
+        resources = std::move(loadedResources);
+        rebuildUserIndex();
+        rebuildResourceIndex();
+    }
+
+    std::vector<char> buildSnapshotImage() const {
+        SnapshotWriter writer;
+        users.forEach([&writer](const User& user) { writer.addUser(user); });
+        for (const auto& resource : resources) {
+            writer.addResource(resource.getName(), resource.getRequiredAccessLevel(), resource.getGrantMask());
+        }
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            writer.addGrant(permissions.kindAt(i), permissions.valueAt(i));
+        }
+        return writer.finish();
+    }
+
+    // Concurrency model: one writer thread owns the mutators, sorts and loads and calls publish() to make
+    // its changes visible; any number of reader threads use snapshot(), which never blocks and never sees
+    // a half-applied change. A snapshot stays valid for as long as its SnapshotRef is held.
+    void publish() {
+        published.publish(buildSnapshotImage(), resourceRows, audit, &activeGrants);
+    }
+
+    SnapshotRef snapshot() const {
+        return published.acquire();
+    }
+
+    // Exports the last published state; safe to call from reader threads while the writer continues
+    void exportUsers(std::ostream& out, ExportFormat format) const {
+        auto current = snapshot();
+        SnapshotExporter(out, format).writeUsers(*current);
+    }
+
+    void exportResources(std::ostream& out, ExportFormat format) const {
+        auto current = snapshot();
+        SnapshotExporter(out, format).writeResources(*current);
+    }
+
+    void saveSnapshot(const std::string& filename) const {
+        std::vector<char> image = buildSnapshotImage();
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Failed to open file for writing");
+        }
+        out.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if (!out) {
+            throw std::runtime_error("Failed to write snapshot");
+        }
+    }
+
+    void loadSnapshot(const std::string& filename) {
+        SnapshotView snapshot(filename);
+        loadFromSnapshot(snapshot);
+    }
+
+    void loadFromSnapshot(const SnapshotView& snapshot) {
+        std::vector<std::unique_ptr<User>> loadedUsers;
+        std::vector<T> loadedResources;
+        loadedUsers.reserve(snapshot.userCount());
+        loadedResources.reserve(snapshot.resourceCount());
+
+        for (size_t i = 0; i < snapshot.userCount(); ++i) {
+            const SnapshotUser& record = snapshot.user(i);
+            loadedUsers.push_back(makeUser(static_cast<UserType>(record.type), std::string(snapshot.name(record)),
+                record.id, record.accessLevel, std::string(snapshot.attribute(record))));
+        }
+        for (size_t i = 0; i < snapshot.resourceCount(); ++i) {
+            const SnapshotResource& record = snapshot.resource(i);
+            loadedResources.push_back(T(std::string(snapshot.name(record)), record.requiredAccessLevel));
+            loadedResources.back().addGrant(record.grantMask);
+        }
+
+        permissions.clear();
+        for (size_t i = 0; i < snapshot.grantCount(); ++i) {
+            const SnapshotGrant& record = snapshot.grant(i);
+            bool allocated;
+            permissions.bitFor(static_cast<PermissionKind>(record.kind), snapshot.value(record), allocated);
+        }
+        users.assign(std::move(loadedUsers));
+        resources = std::move(loadedResources);
+        rebuildUserIndex();
+        rebuildResourceIndex();
+    }
+};
+
+// Readers keep checking a published snapshot's invariants while the writer adds users, re-sorts and republishes
+int runStressTest(unsigned readerCount, int seconds) {
+    AccessControlSystem<Resource> system;
+    system.addResource(Resource("Laboratory 202", 3));
+    system.publish();
+    const int laboratory = system.resourceHandle("Laboratory 202");
+
+    std::atomic<bool> running{ true };
+    std::atomic<uint64_t> checks{ 0 };
+    std::atomic<uint64_t> failures{ 0 };
+
+    std::vector<std::thread> readers;
+    for (unsigned r = 0; r < readerCount; ++r) {
+        readers.emplace_back([&, r] {
+            std::mt19937 random(r);
+            size_t lastCount = 0;
+            uint64_t localChecks = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                auto snapshot = system.snapshot();
+                size_t count = snapshot->userCount();
+                bool ok = count >= lastCount;
+                lastCount = count;
+                for (int i = 0; i < 64 && count > 0; ++i) {
+                    int id = static_cast<int>(random() % count);
+                    const SnapshotUser* user = snapshot->findUser(id);
+                    AccessDecision expected = id % 6 >= 3 ? AccessDecision::Granted : AccessDecision::Denied;
+                    ok = ok && user && user->accessLevel == id % 6 && snapshot->decideAccess(id, laboratory) == expected;
+                }
+                ok = ok && snapshot->findUser(static_cast<int>(count)) == nullptr;
+                if (!ok) {
+                    failures.fetch_add(1, std::memory_order_relaxed);
+                }
+                ++localChecks;
+            }
+            checks.fetch_add(localChecks);
+        });
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    int nextId = 0;
+    uint64_t versions = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        for (int i = 0; i < 1000; ++i, ++nextId) {
+            system.addUser<Student>("Student " + std::to_string(nextId), nextId, nextId % 6, "Group 01");
+        }
+        if (versions % 2) {
+            system.sortUsersByAccessLevel();
+        }
+        else {
+            system.sortUsersById();
+        }
+        system.publish();
+        ++versions;
+    }
+    running = false;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    std::cout << "Published " << versions << " versions (" << nextId << " users), "
+        << checks.load() << " snapshot checks by " << readerCount << " readers, "
+        << failures.load() << " failures" << std::endl;
+    return failures.load() == 0 ? 0 : 1;
+}
+
+// Front end that partitions users by a hash of their id across independent AccessControlSystem shards,
+// each guarded by its own mutex, so mutations of different shards and per-shard work run in parallel.
+// Every shard holds the full resource list, which keeps each check local to the user's shard.
+template<typename T>
+class ShardedAccessControlSystem {
+private:
+    struct Shard {
+        AccessControlSystem<T> system;
+        mutable std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    size_t shardOf(int userId) const {
+        return static_cast<size_t>(((static_cast<uint64_t>(static_cast<uint32_t>(userId)) * 0x9E3779B97F4A7C15ull) >> 32) % shards.size());
+    }
+
+    // Runs fn(shard) for every shard, each on its own thread; exceptions reach the caller
+    template<typename Fn>
+    void forEachShardInParallel(Fn fn) const {
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 1; i < shards.size(); ++i) {
+            tasks.push_back(std::async(std::launch::async, fn, i));
+        }
+        fn(size_t(0));
+        for (auto& task : tasks) {
+            task.get();
+        }
+    }
+
+    template<typename Fn>
+    void forEachShardLocked(Fn fn) {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            fn(shard->system);
+        }
+    }
+
+    std::string shardFileName(const std::string& prefix, size_t shard) const {
+        return prefix + "." + std::to_string(shard) + "of" + std::to_string(shards.size()) + ".snap";
+    }
+
+public:
+    explicit ShardedAccessControlSystem(size_t shardCount = 0) {
+        if (shardCount == 0) {
+            shardCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < shardCount; ++i) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    size_t shardCount() const { return shards.size(); }
+
+    template<typename U>
+    void addUser(const std::string& name, int id, int accessLevel, const std::string& attribute) {
+        Shard& shard = *shards[shardOf(id)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.system.template addUser<U>(name, id, accessLevel, attribute);
+    }
+
+    void setUserAccessLevel(int userId, int newAccessLevel) {
+        Shard& shard = *shards[shardOf(userId)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.system.setUserAccessLevel(userId, newAccessLevel);
+    }
+
+    void setUserName(int userId, const std::string& newName) {
+        Shard& shard = *shards[shardOf(userId)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.system.setUserName(userId, newName);
+    }
+
+    void addResource(const T& resource) {
+        forEachShardLocked([&](AccessControlSystem<T>& system) { system.addResource(resource); });
+    }
+
+    void setResourceRequiredAccessLevel(const std::string& resourceName, int newLevel) {
+        forEachShardLocked([&](AccessControlSystem<T>& system) { system.setResourceRequiredAccessLevel(resourceName, newLevel); });
+    }
+
+    void grantAccess(const std::string& resourceName, PermissionKind kind, const std::string& value) {
+        forEachShardLocked([&](AccessControlSystem<T>& system) { system.grantAccess(resourceName, kind, value); });
+    }
+
+    int resourceHandle(std::string_view resourceName) const {
+        std::lock_guard<std::mutex> lock(shards[0]->mutex);
+        return shards[0]->system.resourceHandle(resourceName);
+    }
+
+    AccessDecision decideAccess(int userId, int resource) const {
+        const Shard& shard = *shards[shardOf(userId)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.system.decideAccess(userId, resource);
+    }
+
+    std::string checkAccess(int userId, const std::string& resourceName) const {
+        const Shard& shard = *shards[shardOf(userId)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.system.checkAccess(userId, resourceName);
+    }
+
+    // Requests are grouped by shard and every shard answers its group under its own lock; large
+    // batches run one thread per shard
+    void checkAccessBatch(const AccessRequest* requests, size_t count, AccessDecision* decisions) const {
+        std::vector<std::vector<size_t>> positions(shards.size());
+        for (size_t i = 0; i < count; ++i) {
+            positions[shardOf(requests[i].userId)].push_back(i);
+        }
+        auto checkShard = [&](size_t s) {
+            const std::vector<size_t>& mine = positions[s];
+            std::vector<AccessRequest> local(mine.size());
+            std::vector<AccessDecision> answers(mine.size());
+            for (size_t k = 0; k < mine.size(); ++k) {
+                local[k] = requests[mine[k]];
+            }
+            {
+                std::lock_guard<std::mutex> lock(shards[s]->mutex);
+                shards[s]->system.checkAccessBatch(local.data(), local.size(), answers.data());
+            }
+            for (size_t k = 0; k < mine.size(); ++k) {
+                decisions[mine[k]] = answers[k];
+            }
+        };
+        if (count < 16384 || shards.size() == 1) {
+            for (size_t s = 0; s < shards.size(); ++s) {
+                checkShard(s);
+            }
+            return;
+        }
+        forEachShardInParallel(checkShard);
+    }
+
+    std::vector<AccessDecision> checkAccessBatch(const std::vector<AccessRequest>& requests) const {
+        std::vector<AccessDecision> decisions(requests.size());
+        checkAccessBatch(requests.data(), requests.size(), decisions.data());
+        return decisions;
+    }
+
+    size_t userCount() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->system.getUserColumns().size();
+        }
+        return total;
+    }
+
+    size_t countWithAccess(int accessLevel) const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->system.countWithAccess(accessLevel);
+        }
+        return total;
+    }
+
+    // One snapshot file per shard, <prefix>.<i>of<n>.snap, written and read concurrently. Loading needs
+    // the same shard count the files were saved with, since it decides which shard owns each user.
+    void saveToFiles(const std::string& prefix) const {
+        forEachShardInParallel([&](size_t s) {
+            std::lock_guard<std::mutex> lock(shards[s]->mutex);
+            shards[s]->system.saveSnapshot(shardFileName(prefix, s));
+        });
+    }
+
+    void loadFromFiles(const std::string& prefix) {
+        for (size_t s = 0; s < shards.size(); ++s) {
+            if (!fileExists(shardFileName(prefix, s))) {
+                throw std::runtime_error("Missing shard file " + shardFileName(prefix, s));
+            }
+        }
+        forEachShardInParallel([&](size_t s) {
+            std::lock_guard<std::mutex> lock(shards[s]->mutex);
+            shards[s]->system.loadSnapshot(shardFileName(prefix, s));
+        });
+    }
+};
+
+// Times adds, a large batch check, save and load with 1, 2, 4, ... shards up to maxShards
+int runShardBenchmark(size_t userCount, size_t maxShards) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); };
+
+    std::mt19937 random(7);
+    std::vector<AccessRequest> requests(4 * userCount);
+    for (size_t shardCount = 1; shardCount <= maxShards; shardCount *= 2) {
+        ShardedAccessControlSystem<Resource> system(shardCount);
+        for (int i = 0; i < 100; ++i) {
+            system.addResource(Resource("Resource " + std::to_string(i), i % 6));
+        }
+        for (auto& request : requests) {
+            request = AccessRequest{ static_cast<int>(random() % userCount), system.resourceHandle("Resource " + std::to_string(random() % 100)) };
+        }
+
+        // As many adding threads as shards; ids are dealt round-robin, so threads meet on shard locks as real clients would
+        auto start = Clock::now();
+        std::vector<std::thread> adders;
+        for (size_t t = 0; t < shardCount; ++t) {
+            adders.emplace_back([&, t] {
+                for (size_t i = t; i < userCount; i += shardCount) {
+                    system.addUser<Student>("Student", static_cast<int>(i), static_cast<int>(i % 6), "Group 01");
+                }
+            });
+        }
+        for (auto& adder : adders) {
+            adder.join();
+        }
+        double addSeconds = seconds(start);
+
+        start = Clock::now();
+        std::vector<AccessDecision> decisions = system.checkAccessBatch(requests);
+        double checkSeconds = seconds(start);
+
+        start = Clock::now();
+        system.saveToFiles("benchmark_shards");
+        double saveSeconds = seconds(start);
+
+        start = Clock::now();
+        system.loadFromFiles("benchmark_shards");
+        double loadSeconds = seconds(start);
+        for (size_t s = 0; s < shardCount; ++s) {
+            std::remove(("benchmark_shards." + std::to_string(s) + "of" + std::to_string(shardCount) + ".snap").c_str());
+        }
+
+        size_t granted = static_cast<size_t>(std::count(decisions.begin(), decisions.end(), AccessDecision::Granted));
+        std::cout << "shards " << shardCount << ": add " << addSeconds << " s, batch of " << requests.size() << " "
+            << checkSeconds << " s, save " << saveSeconds << " s, load " << loadSeconds << " s (" << granted << " granted)" << std::endl;
+    }
+    return 0;
+}
+
+struct BenchmarkResult {
+    std::string operation;
+    size_t operations;
+    double seconds;
+    std::vector<uint64_t> latencies; // nanoseconds, a strided sample of at most kMaxSamples operations
+};
+
+const size_t kMaxSamples = 1000000;
+
+// Runs fn(i) for i in [0, operations), timing every call
+template<typename Fn>
+BenchmarkResult measure(const std::string& operation, size_t operations, Fn fn) {
+    using Clock = std::chrono::steady_clock;
+    BenchmarkResult result{ operation, operations, 0.0, {} };
+    size_t stride = std::max<size_t>(1, operations / kMaxSamples);
+    result.latencies.reserve(std::min(operations, kMaxSamples) + 1);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < operations; ++i) {
+        auto before = Clock::now();
+        fn(i);
+        if (i % stride == 0) {
+            result.latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count()));
+        }
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cerr << operation << ": " << result.seconds << " s" << std::endl;
+    return result;
+}
+
+uint64_t percentile(std::vector<uint64_t>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t rank = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(rank), samples.end());
+    return samples[rank];
+}
+
+// Synthetic population benchmark; prints one JSON document to stdout (progress goes to stderr)
+int runBenchmark(size_t userCount, size_t resourceCount, int studentPercent, int teacherPercent, size_t lookups) {
+    std::mt19937 random(42);
+    std::vector<int> ids(userCount);
+    for (size_t i = 0; i < userCount; ++i) {
+        ids[i] = static_cast<int>(i);
+    }
+    std::shuffle(ids.begin(), ids.end(), random);
+
+    std::vector<UserType> types(userCount);
+    for (auto& type : types) {
+        int roll = static_cast<int>(random() % 100);
+        type = roll < studentPercent ? UserType::Student
+            : roll < studentPercent + teacherPercent ? UserType::Teacher : UserType::Administrator;
+    }
+    // Names repeat every 1000 users so findUsersByName has matches
+    auto userName = [](size_t i) { return "User " + std::to_string(i % 1000); };
+
+    std::vector<BenchmarkResult> results;
+    AccessControlSystem<Resource> system;
+
+    results.push_back(measure("addUser", userCount, [&](size_t i) {
+        switch (types[i]) {
+        case UserType::Student: system.addUser<Student>(userName(i), ids[i], 1 + ids[i] % 5, "Group 03"); break;
+        case UserType::Teacher: system.addUser<Teacher>(userName(i), ids[i], 1 + ids[i] % 5, "Institute of Cross-Cutting Technologies"); break;
+        case UserType::Administrator: system.addUser<Administrator>(userName(i), ids[i], 1 + ids[i] % 5, "Assistant"); break;
+        }
+    }));
+    results.push_back(measure("addResource", resourceCount, [&](size_t i) {
+        system.addResource(Resource("Resource " + std::to_string(i), static_cast<int>(i % 6)));
+    }));
+
+    std::vector<std::string> resourceNames(std::min<size_t>(resourceCount, 1024));
+    for (size_t i = 0; i < resourceNames.size(); ++i) {
+        resourceNames[i] = "Resource " + std::to_string(random() % resourceCount);
+    }
+    std::vector<int> probes(lookups);
+    for (auto& probe : probes) {
+        probe = static_cast<int>(random() % (userCount + userCount / 10)); // ~10% misses
+    }
+
+    size_t sink = 0;
+    results.push_back(measure("checkAccess", lookups, [&](size_t i) {
+        int id = ids[i % userCount];
+        sink += system.checkAccess(id, resourceNames[i % resourceNames.size()]).size();
+    }));
+    results.push_back(measure("findUserById", lookups, [&](size_t i) {
+        sink += system.findUserById(probes[i]) != nullptr;
+    }));
+    results.push_back(measure("findUsersByName", std::min<size_t>(lookups, 100), [&](size_t i) {
+        sink += system.findUsersByName(userName(i * 7)).size();
+    }));
+    // The sorts only select an order, so each is timed together with the ordered walk a display performs
+    results.push_back(measure("sortUsersByAccessLevel", 5, [&](size_t) {
+        system.sortUsersByAccessLevel();
+        system.forEachUser(UserOrder::ByAccessLevel, [&sink](const User& user) { sink += static_cast<size_t>(user.getId()); });
+    }));
+    results.push_back(measure("sortUsersById", 5, [&](size_t) {
+        system.sortUsersById();
+        system.forEachUser(UserOrder::ById, [&sink](const User& user) { sink += static_cast<size_t>(user.getId()); });
+    }));
+
+    const std::string filename = "benchmark_access_system.dat";
+    results.push_back(measure("saveToFile", 3, [&](size_t) { system.saveToFile(filename); }));
+    results.push_back(measure("loadFromFile", 3, [&](size_t) {
+        AccessControlSystem<Resource> loaded;
+        loaded.loadFromFile(filename);
+        sink += loaded.getUserColumns().size();
+    }));
+    std::remove(filename.c_str());
+
+    std::cout << "{\n  \"config\": {\"users\": " << userCount << ", \"resources\": " << resourceCount
+        << ", \"studentPercent\": " << studentPercent << ", \"teacherPercent\": " << teacherPercent
+        << ", \"lookups\": " << lookups << "},\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        BenchmarkResult& result = results[i];
+        std::cout << "    {\"operation\": \"" << result.operation << "\", \"operations\": " << result.operations
+            << ", \"seconds\": " << result.seconds
+            << ", \"opsPerSecond\": " << (result.seconds > 0 ? result.operations / result.seconds : 0.0)
+            << ", \"p50Nanos\": " << percentile(result.latencies, 0.50)
+            << ", \"p99Nanos\": " << percentile(result.latencies, 0.99) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    std::cout << "  ],\n  \"checksum\": " << sink << "\n}" << std::endl;
+    return 0;
+}
+
+struct LayoutTimings {
+    double build, find, check, scan, save, load; // milliseconds
+    size_t checksum;
+};
+
+// Times one AccessControlSystem storage policy end to end on the layout benchmark's population
+template<typename Storage>
+LayoutTimings measureLayout(size_t userCount, const std::string& filename) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+    LayoutTimings timings = {};
+    AccessControlSystem<Resource, Storage> system;
+    system.addResource(Resource("Laboratory 202", 3));
+    const int laboratory = system.resourceHandle("Laboratory 202");
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < userCount; ++i) {
+        int id = static_cast<int>(i);
+        switch (i % 3) {
+        case 0: system.template addUser<Student>("Student " + std::to_string(i), id, 1, "Group 03"); break;
+        case 1: system.template addUser<Teacher>("Teacher " + std::to_string(i), id, 2, "Department"); break;
+        default: system.template addUser<Administrator>("Administrator " + std::to_string(i), id, 3, "Assistant"); break;
+        }
+    }
+    timings.build = millis(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < userCount; ++i) {
+        const User* user = system.findUserById(static_cast<int>(i));
+        timings.checksum += static_cast<size_t>(user->getAccessLevel());
+    }
+    timings.find = millis(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < userCount; ++i) {
+        timings.checksum += static_cast<size_t>(system.decideAccess(static_cast<int>(i), laboratory));
+    }
+    timings.check = millis(start);
+
+    // Per-record work that needs the dynamic type: virtual dispatch versus std::visit on the concrete type
+    start = Clock::now();
+    system.forEachUser(UserOrder::Insertion, [&timings](const auto& user) {
+        timings.checksum += static_cast<size_t>(user.getType()) + static_cast<size_t>(user.getAccessLevel());
+    });
+    timings.scan = millis(start);
+
+    start = Clock::now();
+    system.saveToFile(filename);
+    timings.save = millis(start);
+
+    start = Clock::now();
+    system.loadFromFile(filename);
+    timings.load = millis(start);
+    std::remove(filename.c_str());
+
+    timings.checksum += system.getUserColumns().size();
+    return timings;
+}
+
+// Compares AccessControlSystem with its two user storage policies on the same population
+int runLayoutBenchmark(size_t userCount) {
+    LayoutTimings pointers = measureLayout<PointerUserStore>(userCount, "layout_benchmark_pointers.dat");
+    LayoutTimings flat = measureLayout<FlatUserStore>(userCount, "layout_benchmark_flat.dat");
+    bool match = pointers.checksum == flat.checksum;
+
+    std::cout << "Users: " << userCount << (match ? "" : " (checksum mismatch!)") << '\n'
+        << "                PointerUserStore   FlatUserStore\n"
+        << "build (ms)      " << pointers.build << "\t\t" << flat.build << '\n'
+        << "find (ms)       " << pointers.find << "\t\t" << flat.find << '\n'
+        << "check (ms)      " << pointers.check << "\t\t" << flat.check << '\n'
+        << "scan (ms)       " << pointers.scan << "\t\t" << flat.scan << '\n'
+        << "save (ms)       " << pointers.save << "\t\t" << flat.save << '\n'
+        << "load (ms)       " << pointers.load << "\t\t" << flat.load << std::endl;
+    return match ? 0 : 1;
+}
+
+// Daemon wire protocol. Both ends run on the same host, so integers travel in native byte order. Every
+// message is a DaemonFrame header followed by its payload; clients may pipeline any number of frames on
+// one connection and match the responses, which can arrive out of order, by requestId.
+//   Resolve: payload is `count` bytes of resource name; the response carries one int32 handle (-1 if unknown)
+//   Check:   payload is `count` AccessRequests; the response carries `count` AccessDecision bytes
+//   Error:   response only, empty; the daemon closes the connection after it
+// A frame that declares more than kDaemonMaxName or kDaemonMaxBatch closes the connection without a response.
+enum class DaemonOp : uint16_t {
+    Resolve = 1,
+    Check = 2,
+    Error = 0xFFFF
+};
+
+struct DaemonFrame {
+    uint32_t requestId;
+    uint16_t op;
+    uint16_t reserved;
+    uint32_t count;
+};
+
+const uint32_t kDaemonMaxName = 4096;
+const uint32_t kDaemonMaxBatch = 65536;
+
+// Per connection, reading stops while the unparsed input, unsent output and the responses still owed reach
+// the high-water mark, and resumes once they are below the low-water mark. The low mark leaves room for
+// the largest frame, so a partly received frame can always complete.
+const size_t kDaemonHighWater = 4 << 20;
+const size_t kDaemonLowWater = 1 << 20;
+static_assert(kDaemonLowWater > sizeof(DaemonFrame) + kDaemonMaxBatch * sizeof(AccessRequest), "a whole frame fits below the low-water mark");
+
+bool daemonOversized(const DaemonFrame& frame) {
+    switch (static_cast<DaemonOp>(frame.op)) {
+    case DaemonOp::Resolve: return frame.count > kDaemonMaxName;
+    case DaemonOp::Check: return frame.count > kDaemonMaxBatch;
+    default: return false;
+    }
+}
+
+// Payload bytes that follow a request header, 0 for a malformed one
+size_t daemonRequestSize(const DaemonFrame& frame) {
+    switch (static_cast<DaemonOp>(frame.op)) {
+    case DaemonOp::Resolve: return frame.count <= kDaemonMaxName ? frame.count : 0;
+    case DaemonOp::Check: return frame.count <= kDaemonMaxBatch ? frame.count * sizeof(AccessRequest) : 0;
+    default: return 0;
+    }
+}
+
+size_t daemonResponseSize(const DaemonFrame& frame) {
+    switch (static_cast<DaemonOp>(frame.op)) {
+    case DaemonOp::Resolve: return sizeof(int32_t);
+    case DaemonOp::Check: return frame.count;
+    default: return 0;
+    }
+}
+
+#ifdef __linux__
+bool readFully(int fd, void* data, size_t size) {
+    char* cursor = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t got = ::read(fd, cursor, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        cursor += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+bool writeFully(int fd, const void* data, size_t size) {
+    const char* cursor = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(fd, cursor, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        cursor += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+sockaddr_un daemonAddress(const std::string& socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path is too long: " + socketPath);
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return address;
+}
+
+// Serves access decisions for one system over a Unix domain socket. A single epoll loop accepts
+// connections and cuts their input into frames; a pool of workers answers each frame from the
+// system's published snapshot and hands the response back through an eventfd-signalled queue.
+class AccessDaemon {
+private:
+    struct Connection {
+        int fd;
+        std::vector<char> input;
+        std::vector<char> output;
+        size_t sent = 0;
+        bool writable = true; // false while waiting for EPOLLOUT
+        bool closeAfterFlush = false;
+        size_t pending = 0; // queued requests whose responses have not been delivered yet
+        std::vector<char> rejection; // error frame for a malformed request, sent after the pending responses
+        size_t owed = 0; // payload and response bytes of the pending requests
+        bool reading = true; // false while over the high-water mark or after a malformed request
+    };
+
+    struct Job {
+        uint64_t connection;
+        DaemonFrame frame;
+        std::vector<char> payload;
+        size_t owed;
+    };
+
+    struct Completion {
+        uint64_t connection;
+        std::vector<char> bytes;
+        size_t owed;
+    };
+
+    static const uint64_t kListenerId = 0;
+    static const uint64_t kWakeId = 1;
+
+    const AccessControlSystem<Resource>& system;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::map<uint64_t, Connection> connections;
+    uint64_t nextConnection = 2;
+
+    std::deque<Job> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsReady;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    std::vector<Completion> completions;
+    std::mutex completionsMutex;
+
+    static std::atomic<bool>& stopRequested() {
+        static std::atomic<bool> flag{ false };
+        return flag;
+    }
+
+    static void onSignal(int) {
+        stopRequested().store(true);
+    }
+
+    void watch(int fd, uint64_t id, uint32_t events, int op = EPOLL_CTL_ADD) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.u64 = id;
+        if (epoll_ctl(epollFd, op, fd, &event) != 0) {
+            throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+        }
+    }
+
+    static std::vector<char> respond(const DaemonFrame& request, const std::vector<char>& payload, const PublishedSnapshot& snapshot) {
+        DaemonFrame header = request;
+        header.count = static_cast<DaemonOp>(request.op) == DaemonOp::Resolve ? 1 : request.count;
+        std::vector<char> bytes(sizeof(header) + daemonResponseSize(request));
+        std::memcpy(bytes.data(), &header, sizeof(header));
+        char* body = bytes.data() + sizeof(header);
+
+        if (static_cast<DaemonOp>(request.op) == DaemonOp::Resolve) {
+            int32_t handle = ResourceNames::instance().find(std::string_view(payload.data(), payload.size()));
+            std::memcpy(body, &handle, sizeof(handle));
+        }
+        else {
+            for (uint32_t i = 0; i < request.count; ++i) {
+                AccessRequest check;
+                std::memcpy(&check, payload.data() + i * sizeof(AccessRequest), sizeof(check));
+                body[i] = static_cast<char>(snapshot.decideAccess(check.userId, check.resource));
+            }
+        }
+        return bytes;
+    }
+
+    void workerLoop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(jobsMutex);
+                jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            auto snapshot = system.snapshot();
+            Completion done{ job.connection, respond(job.frame, job.payload, *snapshot), job.owed };
+            {
+                std::lock_guard<std::mutex> lock(completionsMutex);
+                completions.push_back(std::move(done));
+            }
+            uint64_t one = 1;
+            if (::write(wakeFd, &one, sizeof(one)) < 0) {
+                // The counter only saturates when the loop is far behind; it is woken regardless
+            }
+        }
+    }
+
+    void closeConnection(uint64_t id) {
+        auto found = connections.find(id);
+        if (found != connections.end()) {
+            ::close(found->second.fd);
+            connections.erase(found);
+        }
+    }
+
+    static size_t buffered(const Connection& connection) {
+        return connection.input.size() + connection.output.size() - connection.sent + connection.owed;
+    }
+
+    static uint32_t interest(const Connection& connection) {
+        return (connection.reading ? uint32_t(EPOLLIN) : 0u) | (connection.writable ? 0u : uint32_t(EPOLLOUT));
+    }
+
+    // Stops reading at the high-water mark and resumes below the low-water mark
+    void throttle(uint64_t id, Connection& connection) {
+        bool reading = connection.rejection.empty() && !connection.closeAfterFlush
+            && buffered(connection) < (connection.reading ? kDaemonHighWater : kDaemonLowWater);
+        if (reading != connection.reading) {
+            connection.reading = reading;
+            watch(connection.fd, id, interest(connection), EPOLL_CTL_MOD);
+        }
+    }
+
+    // Writes as much queued output as the socket takes; returns false if the connection was closed
+    bool flush(uint64_t id, Connection& connection) {
+        while (connection.sent < connection.output.size()) {
+            ssize_t sent = ::send(connection.fd, connection.output.data() + connection.sent,
+                connection.output.size() - connection.sent, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (connection.writable) {
+                    connection.writable = false;
+                    watch(connection.fd, id, interest(connection), EPOLL_CTL_MOD);
+                }
+                throttle(id, connection);
+                return true;
+            }
+            if (sent <= 0) {
+                closeConnection(id);
+                return false;
+            }
+            connection.sent += static_cast<size_t>(sent);
+        }
+        connection.output.clear();
+        connection.sent = 0;
+        if (!connection.writable) {
+            connection.writable = true;
+            watch(connection.fd, id, interest(connection), EPOLL_CTL_MOD);
+        }
+        if (connection.closeAfterFlush) {
+            closeConnection(id);
+            return false;
+        }
+        throttle(id, connection);
+        return true;
+    }
+
+    // Once a malformed request was seen and every earlier response is queued, adds the error frame and
+    // closes the connection after writing it all
+    void finishRejected(Connection& connection) {
+        if (!connection.rejection.empty() && connection.pending == 0) {
+            connection.output.insert(connection.output.end(), connection.rejection.begin(), connection.rejection.end());
+            connection.rejection.clear();
+            connection.closeAfterFlush = true;
+        }
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            uint64_t id = nextConnection++;
+            connections.emplace(id, Connection{ fd, {}, {}, 0, true, false, 0, {}, 0, true });
+            watch(fd, id, EPOLLIN);
+        }
+    }
+
+    // Reads what is available up to the high-water mark and queues every complete frame; returns false if
+    // the connection was closed
+    bool readRequests(uint64_t id, Connection& connection) {
+        char buffer[65536];
+        while (buffered(connection) < kDaemonHighWater) {
+            ssize_t got = ::read(connection.fd, buffer, sizeof(buffer));
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (got <= 0) {
+                closeConnection(id);
+                return false;
+            }
+            connection.input.insert(connection.input.end(), buffer, buffer + got);
+        }
+        if (!connection.rejection.empty() || connection.closeAfterFlush) {
+            // Nothing after a malformed request is answered
+            connection.input.clear();
+            return true;
+        }
+
+        size_t pos = 0;
+        std::vector<Job> parsed;
+        while (connection.input.size() - pos >= sizeof(DaemonFrame)) {
+            DaemonFrame frame;
+            std::memcpy(&frame, connection.input.data() + pos, sizeof(frame));
+            if (daemonOversized(frame)) {
+                closeConnection(id);
+                return false;
+            }
+            size_t payloadSize = daemonRequestSize(frame);
+            if (payloadSize == 0 && !(static_cast<DaemonOp>(frame.op) == DaemonOp::Check && frame.count == 0)) {
+                DaemonFrame error = frame;
+                error.op = static_cast<uint16_t>(DaemonOp::Error);
+                error.count = 0;
+                const char* bytes = reinterpret_cast<const char*>(&error);
+                connection.rejection.assign(bytes, bytes + sizeof(error));
+                connection.input.clear();
+                pos = 0;
+                break;
+            }
+            if (connection.input.size() - pos - sizeof(frame) < payloadSize) {
+                break;
+            }
+            const char* payload = connection.input.data() + pos + sizeof(frame);
+            size_t owed = payloadSize + sizeof(frame) + daemonResponseSize(frame);
+            parsed.push_back(Job{ id, frame, std::vector<char>(payload, payload + payloadSize), owed });
+            connection.owed += owed;
+            pos += sizeof(frame) + payloadSize;
+        }
+        connection.input.erase(connection.input.begin(), connection.input.begin() + static_cast<std::ptrdiff_t>(pos));
+
+        if (!parsed.empty()) {
+            connection.pending += parsed.size();
+            {
+                std::lock_guard<std::mutex> lock(jobsMutex);
+                for (auto& job : parsed) {
+                    jobs.push_back(std::move(job));
+                }
+            }
+            jobsReady.notify_all();
+        }
+        finishRejected(connection);
+        if (connection.closeAfterFlush && connection.writable) {
+            return flush(id, connection);
+        }
+        throttle(id, connection);
+        return true;
+    }
+
+    void deliverCompletions() {
+        uint64_t counter;
+        if (::read(wakeFd, &counter, sizeof(counter)) < 0) {
+            return;
+        }
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(completionsMutex);
+            ready.swap(completions);
+        }
+        // Responses for connections that have gone away are dropped
+        std::vector<uint64_t> touched;
+        for (auto& done : ready) {
+            auto found = connections.find(done.connection);
+            if (found != connections.end()) {
+                found->second.output.insert(found->second.output.end(), done.bytes.begin(), done.bytes.end());
+                --found->second.pending;
+                found->second.owed -= done.owed;
+                finishRejected(found->second);
+                touched.push_back(done.connection);
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (uint64_t id : touched) {
+            auto found = connections.find(id);
+            if (found != connections.end() && found->second.writable) {
+                flush(id, found->second);
+            }
+            else if (found != connections.end()) {
+                throttle(id, found->second);
+            }
+        }
+    }
+
+public:
+    AccessDaemon(const AccessControlSystem<Resource>& system, const std::string& socketPath, unsigned workerCount)
+        : system(system) {
+        sockaddr_un address = daemonAddress(socketPath);
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        ::unlink(socketPath.c_str());
+        if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(listenFd, SOMAXCONN) != 0) {
+            throw std::runtime_error("Failed to listen on " + socketPath + ": " + std::strerror(errno));
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) {
+            throw std::runtime_error(std::string("Failed to set up the event loop: ") + std::strerror(errno));
+        }
+        watch(listenFd, kListenerId, EPOLLIN);
+        watch(wakeFd, kWakeId, EPOLLIN);
+
+        if (workerCount == 0) {
+            workerCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < workerCount; ++i) {
+            workers.emplace_back(&AccessDaemon::workerLoop, this);
+        }
+    }
+
+    ~AccessDaemon() {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            stopping = true;
+        }
+        jobsReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (auto& connection : connections) {
+            ::close(connection.second.fd);
+        }
+        ::close(wakeFd);
+        ::close(epollFd);
+        ::close(listenFd);
+    }
+
+    AccessDaemon(const AccessDaemon&) = delete;
+    AccessDaemon& operator=(const AccessDaemon&) = delete;
+
+    // Makes run() return within one poll interval; callable from any thread
+    void stop() {
+        stopRequested().store(true);
+    }
+
+    // Runs the event loop until SIGINT, SIGTERM or stop()
+    void run() {
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        epoll_event events[64];
+        while (!stopRequested().load()) {
+            int ready = epoll_wait(epollFd, events, 64, 200);
+            for (int i = 0; i < ready; ++i) {
+                uint64_t id = events[i].data.u64;
+                if (id == kListenerId) {
+                    acceptConnections();
+                    continue;
+                }
+                if (id == kWakeId) {
+                    deliverCompletions();
+                    continue;
+                }
+                auto found = connections.find(id);
+                if (found == connections.end()) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    closeConnection(id);
+                    continue;
+                }
+                if ((events[i].events & EPOLLOUT) && !flush(id, found->second)) {
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    readRequests(id, found->second);
+                }
+            }
+        }
+    }
+};
+
+// Serves the data file, or a synthetic population shaped like the benchmark's, until interrupted
+int runDaemon(const std::string& socketPath, unsigned workerCount, const std::string& dataFile) {
+    AccessControlSystem<Resource> system;
+    if (!dataFile.empty()) {
+        system.loadFromFileParallel(dataFile);
+    }
+    else {
+        for (int i = 0; i < 100000; ++i) {
+            system.addUser<Student>("User " + std::to_string(i % 1000), i, i % 6, "Group 03");
+        }
+        for (int i = 0; i < 1000; ++i) {
+            system.addResource(Resource("Resource " + std::to_string(i), i % 6));
+        }
+    }
+    system.publish();
+
+    AccessDaemon daemon(system, socketPath, workerCount);
+    std::cerr << "Serving " << system.getUserColumns().size() << " users on " << socketPath << std::endl;
+    daemon.run();
+    ::unlink(socketPath.c_str());
+    return 0;
+}
+
+// Each connection keeps `pipeline` Check frames of `batch` requests in flight against the synthetic
+// population; prints throughput and per-frame round-trip latency as JSON
+int runLoadGenerator(const std::string& socketPath, unsigned connectionCount, int seconds, unsigned batch, unsigned pipeline) {
+    using Clock = std::chrono::steady_clock;
+    if (batch == 0 || batch > kDaemonMaxBatch || pipeline == 0 || pipeline > 0xFFFF) {
+        std::cerr << "Batch must be 1.." << kDaemonMaxBatch << " and pipeline 1..65535" << std::endl;
+        return 1;
+    }
+
+    std::atomic<uint64_t> frames{ 0 };
+    std::atomic<uint64_t> failures{ 0 };
+    std::vector<std::vector<uint64_t>> samples(connectionCount);
+    auto deadline = Clock::now() + std::chrono::seconds(seconds);
+
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < connectionCount; ++c) {
+        clients.emplace_back([&, c] {
+            sockaddr_un address = daemonAddress(socketPath);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                failures.fetch_add(1);
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                return;
+            }
+
+            std::vector<int32_t> handles;
+            for (int i = 0; i < 16; ++i) {
+                std::string name = "Resource " + std::to_string(i);
+                DaemonFrame request{ static_cast<uint32_t>(i), static_cast<uint16_t>(DaemonOp::Resolve), 0, static_cast<uint32_t>(name.size()) };
+                DaemonFrame response;
+                int32_t handle;
+                if (!writeFully(fd, &request, sizeof(request)) || !writeFully(fd, name.data(), name.size())
+                    || !readFully(fd, &response, sizeof(response)) || !readFully(fd, &handle, sizeof(handle))) {
+                    failures.fetch_add(1);
+                    ::close(fd);
+                    return;
+                }
+                handles.push_back(handle);
+            }
+
+            std::mt19937 random(c);
+            std::vector<char> frame(sizeof(DaemonFrame) + batch * sizeof(AccessRequest));
+            std::vector<char> decisions(batch);
+            std::vector<Clock::time_point> sentAt(pipeline);
+            std::vector<uint64_t>& latencies = samples[c];
+            uint32_t sequence = 0;
+            uint64_t completed = 0;
+
+            // The low 16 bits of a request id name its pipeline slot, the rest is a sequence number
+            auto send = [&](uint32_t slot) {
+                DaemonFrame header{ (++sequence << 16) | slot, static_cast<uint16_t>(DaemonOp::Check), 0, batch };
+                std::memcpy(frame.data(), &header, sizeof(header));
+                for (unsigned i = 0; i < batch; ++i) {
+                    AccessRequest check{ static_cast<int>(random() % 100000), handles[random() % handles.size()] };
+                    std::memcpy(frame.data() + sizeof(header) + i * sizeof(check), &check, sizeof(check));
+                }
+                sentAt[slot] = Clock::now();
+                return writeFully(fd, frame.data(), frame.size());
+            };
+
+            bool ok = true;
+            for (uint32_t slot = 0; slot < pipeline && ok; ++slot) {
+                ok = send(slot);
+            }
+            unsigned inFlight = pipeline;
+            while (ok && inFlight > 0) {
+                DaemonFrame response;
+                if (!readFully(fd, &response, sizeof(response)) || response.op != static_cast<uint16_t>(DaemonOp::Check)
+                    || response.count != batch || !readFully(fd, decisions.data(), batch)) {
+                    ok = false;
+                    break;
+                }
+                uint32_t slot = response.requestId & 0xFFFF;
+                if (latencies.size() < kMaxSamples / std::max(1u, connectionCount)) {
+                    latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sentAt[slot]).count()));
+                }
+                ++completed;
+                --inFlight;
+                if (Clock::now() < deadline) {
+                    ok = send(slot);
+                    ++inFlight;
+                }
+            }
+            if (!ok) {
+                failures.fetch_add(1);
+            }
+            frames.fetch_add(completed);
+            ::close(fd);
+        });
+    }
+
+    auto start = Clock::now();
+    for (auto& client : clients) {
+        client.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint64_t> latencies;
+    for (auto& client : samples) {
+        latencies.insert(latencies.end(), client.begin(), client.end());
+    }
+    std::cout << "{\"connections\": " << connectionCount << ", \"batch\": " << batch << ", \"pipeline\": " << pipeline
+        << ", \"seconds\": " << elapsed << ", \"frames\": " << frames.load()
+        << ", \"framesPerSecond\": " << frames.load() / elapsed
+        << ", \"checksPerSecond\": " << frames.load() * batch / elapsed
+        << ", \"p50Nanos\": " << percentile(latencies, 0.50) << ", \"p99Nanos\": " << percentile(latencies, 0.99)
+        << ", \"failedConnections\": " << failures.load() << "}" << std::endl;
+    return failures.load() == 0 ? 0 : 1;
+}
+#endif
+
+// The resources of the demo below, known at build time
+constexpr FixedResourceSpec kCampusResources[] = {
+    { "Audience 1-384", 1 },
+    { "Laboratory 202", 3 },
+    { "Scientific library", 2 },
+    { "Dean's office", 4 },
+    { "Director's office", 5 }
+};
+constexpr auto kCampusRegistry = makePerfectHashRegistry(kCampusResources);
+static_assert(kCampusRegistry.levelOf("Laboratory 202") == 3, "registry lookups run at compile time");
+using CampusResource = FixedResource<kCampusRegistry>;
+
+// Checks for the "check" mode: each group records what failed, and the mode exits non-zero if anything did
+struct CheckReport {
+    int checks = 0;
+    int failures = 0;
+
+    void expect(bool ok, const std::string& what) {
+        ++checks;
+        if (!ok) {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    }
+};
+
+void checkGrants(CheckReport& report) {
+    const std::string snapshotFile = "selfcheck-grants.snapshot", journalFile = "selfcheck-grants.journal";
+    std::remove(snapshotFile.c_str());
+    std::remove(journalFile.c_str());
+    auto granted = [](const AccessControlSystem<Resource>& system, int userId, const char* resource) {
+        return system.decideAccess(userId, system.resourceHandle(resource)) == AccessDecision::Granted;
+    };
+    {
+        AccessControlSystem<Resource> system;
+        system.recover(snapshotFile, journalFile);
+        system.addUser<Student>("Student", 1, 1, "Group 03");
+        system.addUser<Teacher>("Teacher", 2, 1, "Physics");
+        system.addResource(Resource("Laboratory", 3));
+        system.addResource(Resource("Library", 3));
+        system.grantAccess("Laboratory", PermissionKind::Group, "Group 03");
+        system.compactJournal(snapshotFile);
+        system.grantAccess("Library", PermissionKind::Department, "Physics");
+        system.waitForCompaction();
+    }
+    {
+        AccessControlSystem<Resource> system;
+        system.recover(snapshotFile, journalFile);
+        report.expect(granted(system, 1, "Laboratory"), "a grant folded into the snapshot survives recovery");
+        report.expect(granted(system, 2, "Library"), "a journaled grant survives recovery");
+        report.expect(!granted(system, 2, "Laboratory") && !granted(system, 1, "Library"), "recovered grants stay with their attribute");
+        system.addUser<Student>("Late student", 3, 1, "Group 03");
+        report.expect(granted(system, 3, "Laboratory"), "users added after recovery pick up restored grants");
+        report.expect(system.accessibleResources(1).size() == 1, "accessibleResources sees restored grants");
+    }
+    std::remove(snapshotFile.c_str());
+    std::remove(journalFile.c_str());
+
+    AccessControlSystem<Resource> system;
+    system.addUser<Student>("Student", 1, 1, "Group 31");
+    system.addResource(Resource("Laboratory", 3));
+    for (uint32_t i = 0; i < PermissionRegistry::kMaxGrants; ++i) {
+        system.grantAccess("Laboratory", PermissionKind::Group, "Group " + std::to_string(i));
+    }
+    bool threw = false;
+    try {
+        system.grantAccess("Laboratory", PermissionKind::Group, "Group 32");
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    report.expect(threw, "granting a 33rd attribute throws");
+    system.grantAccess("Laboratory", PermissionKind::Group, "Group 31");
+    report.expect(granted(system, 1, "Laboratory"), "known attributes can still be granted at the cap");
+}
+
+// The same operations through both user storage policies must give the same answers
+template<typename Storage>
+std::string describeUserStorage(const std::string& filename) {
+    AccessControlSystem<Resource, Storage> system;
+    system.template addUser<Student>("Student", 1, 1, "Group 03");
+    system.template addUser<Teacher>("Teacher", 2, 2, "Physics");
+    system.template addUser<Administrator>("Administrator", 3, 4, "Assistant");
+    try {
+        system.template addUser<Student>("Duplicate", 2, 5, "Group 01");
+    }
+    catch (const std::invalid_argument&) {
+    }
+    system.addResource(Resource("Laboratory", 3));
+    system.grantAccess("Laboratory", PermissionKind::Department, "Physics");
+    system.setUserAccessLevel(1, 3);
+    system.saveToFile(filename);
+    system.loadFromFile(filename);
+    std::remove(filename.c_str());
+
+    std::string result;
+    system.forEachUser(UserOrder::ByAccessLevel, [&result](const User& user) {
+        result += user.getName() + ":" + std::to_string(user.getAccessLevel()) + " ";
+    });
+    for (int id = 1; id <= 4; ++id) {
+        const User* user = system.findUserById(id);
+        result += (user ? user->getName() : "-") + "=" + std::to_string(static_cast<int>(system.decideAccess(id, system.resourceHandle("Laboratory")))) + " ";
+    }
+    return result;
+}
+
+void checkUserStorage(CheckReport& report) {
+    std::string pointers = describeUserStorage<PointerUserStore>("selfcheck-pointers.dat");
+    std::string flat = describeUserStorage<FlatUserStore>("selfcheck-flat.dat");
+    report.expect(pointers == flat, "PointerUserStore and FlatUserStore agree (" + pointers + "| " + flat + ")");
+    report.expect(pointers == "Teacher:2 Student:3 Administrator:4 Student=1 Teacher=0 Administrator=1 -=2 ",
+        "user storage answers are right (" + pointers + ")");
+}
+
+// Every kind of damage must be refused by SnapshotView rather than read out of bounds
+void checkSnapshotValidation(CheckReport& report) {
+    AccessControlSystem<Resource> system;
+    system.addUser<Student>("Student", 1, 1, "Group 03");
+    system.addUser<Teacher>("Teacher", 2, 2, "Physics");
+    system.addResource(Resource("Laboratory", 3));
+    system.grantAccess("Laboratory", PermissionKind::Group, "Group 03");
+    const std::vector<char> image = system.buildSnapshotImage();
+    SnapshotHeader header;
+    std::memcpy(&header, image.data(), sizeof(header));
+
+    auto rejects = [](std::vector<char> damaged) {
+        try {
+            SnapshotView view(std::move(damaged));
+        }
+        catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    auto patched = [&image](size_t offset, uint32_t value) {
+        std::vector<char> damaged = image;
+        std::memcpy(damaged.data() + offset, &value, sizeof(value));
+        return damaged;
+    };
+
+    {
+        SnapshotView view{ std::vector<char>(image) };
+        report.expect(view.decideAccess(1, "Laboratory") == AccessDecision::Granted, "an intact snapshot is served");
+    }
+    report.expect(rejects(std::vector<char>(image.begin(), image.begin() + sizeof(SnapshotHeader) - 1)), "a snapshot shorter than its header is rejected");
+    report.expect(rejects(std::vector<char>(image.begin(), image.end() - 1)), "a truncated snapshot is rejected");
+    report.expect(rejects(patched(offsetof(SnapshotHeader, magic), 0)), "a bad magic number is rejected");
+    report.expect(rejects(patched(offsetof(SnapshotHeader, version), kSnapshotVersion + 1)), "an unknown version is rejected");
+    report.expect(rejects(patched(offsetof(SnapshotHeader, userCount), header.userSlotCount + 1)), "a user count beyond the slots is rejected");
+    report.expect(rejects(patched(offsetof(SnapshotHeader, userSlotCount), 6)), "a slot count that is not a power of two is rejected");
+    report.expect(rejects(patched(offsetof(SnapshotHeader, grantCount), PermissionRegistry::kMaxGrants + 1)), "too many grant attributes are rejected");
+    report.expect(rejects(patched(header.usersOffset + offsetof(SnapshotUser, type), 7)), "an unknown user type is rejected");
+    report.expect(rejects(patched(header.usersOffset + offsetof(SnapshotUser, nameLength), 0xFFFFFFF0u)), "a user name outside the heap is rejected");
+    report.expect(rejects(patched(header.resourcesOffset + offsetof(SnapshotResource, nameOffset), 0xFFFFFFF0u)), "a resource name outside the heap is rejected");
+    report.expect(rejects(patched(header.grantsOffset + offsetof(SnapshotGrant, kind), 3)), "an unknown grant kind is rejected");
+    report.expect(rejects(patched(header.userSlotsOffset, header.userCount + 1)), "an index slot past the rows is rejected");
+
+    const std::string filename = "selfcheck-truncated.snapshot";
+    writeFileDurably(filename, image.data(), image.size() / 2);
+    bool threw = false;
+    try {
+        SnapshotView view(filename);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    std::remove(filename.c_str());
+    report.expect(threw, "a truncated snapshot file is rejected");
+}
+
+// Recovery replays the journal on top of the snapshot and stops cleanly at a torn tail record
+void checkJournalRecovery(CheckReport& report) {
+    const std::string snapshotFile = "selfcheck-journal.snapshot", journalFile = "selfcheck-journal.journal";
+    auto cleanUp = [&] {
+        std::remove(snapshotFile.c_str());
+        std::remove(journalFile.c_str());
+        std::remove((journalFile + ".1").c_str());
+    };
+    auto chopJournal = [&journalFile](size_t bytes) {
+        std::string contents;
+        {
+            MappedFile file(journalFile);
+            contents.assign(file.data(), file.size());
+        }
+        writeFileDurably(journalFile, contents.data(), contents.size() - std::min(bytes, contents.size()));
+    };
+    cleanUp();
+    {
+        AccessControlSystem<Resource> system;
+        system.recover(snapshotFile, journalFile);
+        system.addUser<Student>("Student", 1, 1, "Group 03");
+        system.addUser<Teacher>("Teacher", 2, 2, "Physics");
+        system.addResource(Resource("Laboratory", 3));
+        system.compactJournal(snapshotFile);
+        system.setUserAccessLevel(1, 4);
+        system.setUserName(2, "Renamed teacher");
+        system.setResourceRequiredAccessLevel("Laboratory", 2);
+        system.addUser<Administrator>("Administrator", 3, 5, "Assistant");
+        system.waitForCompaction();
+        system.syncJournal();
+    }
+    {
+        AccessControlSystem<Resource> system;
+        system.recover(snapshotFile, journalFile);
+        const User* student = system.findUserById(1);
+        const User* teacher = system.findUserById(2);
+        report.expect(student && student->getAccessLevel() == 4, "a journaled access level change is replayed");
+        report.expect(teacher && teacher->getName() == "Renamed teacher", "a journaled rename is replayed");
+        report.expect(system.decideAccess(2, system.resourceHandle("Laboratory")) == AccessDecision::Granted,
+            "a journaled required level change is replayed");
+        report.expect(system.findUserById(3) != nullptr, "a journaled user is replayed");
+
+        system.addUser<Student>("Kept", 4, 1, "Group 01");
+        system.addUser<Student>("Torn", 5, 1, "Group 01");
+        system.syncJournal();
+    }
+    chopJournal(3);
+    {
+        AccessControlSystem<Resource> system;
+        system.recover(snapshotFile, journalFile);
+        report.expect(system.findUserById(4) != nullptr, "records before a torn tail survive");
+        report.expect(system.findUserById(5) == nullptr, "a torn tail record is dropped");
+        report.expect(system.findUserById(1) && system.findUserById(3), "the snapshot survives a torn journal");
+
+        system.addUser<Student>("After recovery", 6, 1, "Group 01");
+        system.syncJournal();
+    }
+    {
+        AccessControlSystem<Resource> system;
+        system.recover(snapshotFile, journalFile);
+        report.expect(system.findUserById(6) && system.findUserById(4) && !system.findUserById(5),
+            "the journal keeps working after a torn tail was recovered");
+    }
+    cleanUp();
+}
+
+// The parallel loader must build exactly what the sequential one does, at any thread count
+void checkParallelLoader(CheckReport& report) {
+    const std::string dataFile = "selfcheck-loader.dat", copyFile = "selfcheck-loader-copy.dat";
+    auto contents = [](const std::string& filename) {
+        std::ifstream in(filename, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    {
+        AccessControlSystem<Resource> system;
+        for (int i = 0; i < 60000; ++i) {
+            switch (i % 3) {
+            case 0: system.addUser<Student>("Student " + std::to_string(i), i, i % 6, "Group " + std::to_string(i % 40)); break;
+            case 1: system.addUser<Teacher>("Teacher " + std::to_string(i), i, i % 6, "Department " + std::to_string(i % 7)); break;
+            default: system.addUser<Administrator>("Administrator " + std::to_string(i), i, i % 6, "Position " + std::to_string(i % 5)); break;
+            }
+        }
+        for (int i = 0; i < 700; ++i) {
+            system.addResource(Resource("Resource " + std::to_string(i), i % 6));
+        }
+        system.saveToFile(dataFile);
+    }
+
+    AccessControlSystem<Resource> sequential;
+    sequential.loadFromFile(dataFile);
+    sequential.saveToFile(copyFile);
+    const std::string expected = contents(copyFile);
+    report.expect(expected == contents(dataFile), "the sequential loader round-trips the data file");
+    for (unsigned threads : { 1u, 2u, 3u, 8u }) {
+        AccessControlSystem<Resource> parallel;
+        parallel.loadFromFileParallel(dataFile, threads);
+        parallel.saveToFile(copyFile);
+        report.expect(contents(copyFile) == expected, "the parallel loader on " + std::to_string(threads) + " threads matches the sequential one");
+        report.expect(parallel.decideAccess(59999, parallel.resourceHandle("Resource 5")) == sequential.decideAccess(59999, sequential.resourceHandle("Resource 5")),
+            "parallel and sequential loads decide alike on " + std::to_string(threads) + " threads");
+    }
+
+    // A file that declares more users than it holds and ends after them
+    const std::string full = contents(dataFile);
+    std::string damaged = "60001" + full.substr(full.find('\n'), full.rfind("\n700\n") + 1 - full.find('\n'));
+    writeFileDurably(copyFile, damaged.data(), damaged.size());
+    std::string message;
+    try {
+        AccessControlSystem<Resource> parallel;
+        parallel.loadFromFileParallel(copyFile, 4);
+    }
+    catch (const std::runtime_error& e) {
+        message = e.what();
+    }
+    report.expect(message.find("declares 60001 users but has 60000") != std::string::npos, "the parallel loader reports a short user section (" + message + ")");
+    std::remove(dataFile.c_str());
+    std::remove(copyFile.c_str());
+}
+
+// Every timer fires exactly once, in the first advance that reaches its deadline, whichever level it was
+// filed on and however often it cascaded
+void checkTimerWheel(CheckReport& report) {
+    std::mt19937_64 random(15);
+    const int64_t start = 1000003;
+    TimerWheel wheel(start);
+    std::multimap<int64_t, uint64_t> expected; // deadline -> id, the timers not fired yet
+    int64_t now = start;
+    uint64_t nextId = 0;
+    size_t early = 0, late = 0, unknown = 0, fired = 0;
+    std::vector<TimerWheel::Timer> expired;
+    for (int step = 0; step < 4000; ++step) {
+        for (int i = 0; i < 8; ++i) {
+            // From overdue to well past the horizon of 2^24 ticks, so the top level has to re-file
+            static const int64_t spans[] = { 1, 64, 4096, 262144, int64_t(1) << 24, int64_t(1) << 27 };
+            int64_t deadline = now - 2 + static_cast<int64_t>(random() % static_cast<uint64_t>(spans[random() % 6]));
+            wheel.schedule(deadline, nextId);
+            expected.emplace(deadline, nextId++);
+        }
+        static const int64_t steps[] = { 0, 1, 63, 4095, 300000, int64_t(1) << 22 };
+        now += static_cast<int64_t>(random() % static_cast<uint64_t>(steps[random() % 6] + 1));
+        expired.clear();
+        wheel.advance(now, expired);
+        for (const TimerWheel::Timer& timer : expired) {
+            ++fired;
+            auto range = expected.equal_range(timer.deadline);
+            auto found = std::find_if(range.first, range.second, [&timer](const auto& entry) { return entry.second == timer.id; });
+            if (found == range.second) {
+                ++unknown;
+                continue;
+            }
+            early += timer.deadline > now;
+            expected.erase(found);
+        }
+        late += static_cast<size_t>(std::distance(expected.begin(), expected.upper_bound(now)));
+    }
+    report.expect(early == 0, "no timer fires before its deadline");
+    report.expect(late == 0, "every due timer fires in the advance that reaches it");
+    report.expect(unknown == 0, "every timer fires at most once");
+    report.expect(wheel.size() == expected.size(), "the wheel counts its pending timers");
+
+    expired.clear();
+    wheel.advance(now + (int64_t(1) << 30), expired);
+    report.expect(expired.size() == expected.size() && wheel.size() == 0, "a long advance drains the wheel");
+    report.expect(fired + expired.size() == nextId, "all " + std::to_string(nextId) + " timers fired");
+
+    AccessControlSystem<Resource> system;
+    system.addUser<Student>("Student", 1, 1, "Group 03");
+    system.addResource(Resource("Laboratory", 3));
+    const int laboratory = system.resourceHandle("Laboratory");
+    const auto epoch = std::chrono::system_clock::now();
+    system.grantTemporaryAccess(1, "Laboratory", 3, epoch + std::chrono::hours(24 * 400));
+    report.expect(system.decideAccess(1, laboratory) == AccessDecision::Granted, "a temporary grant lets the user in");
+    report.expect(system.expireTemporaryGrants(epoch + std::chrono::hours(24 * 399)) == 0, "a grant past the horizon is kept until it is due");
+    report.expect(system.expireTemporaryGrants(epoch + std::chrono::hours(24 * 400) + std::chrono::seconds(1)) == 1,
+        "a grant past the horizon expires when due");
+    report.expect(system.decideAccess(1, laboratory) == AccessDecision::Denied, "an expired grant no longer lets the user in");
+}
+
+#ifdef __linux__
+// Drives an in-process daemon over its socket: pipelined and split frames, a malformed frame after valid
+// ones, an empty batch and an oversized frame
+void checkDaemonFrames(CheckReport& report) {
+    const std::string socketPath = "selfcheck-daemon.sock";
+    AccessControlSystem<Resource> system;
+    for (int i = 0; i < 12; ++i) {
+        system.addUser<Student>("Student " + std::to_string(i), i, i % 6, "Group 03");
+    }
+    system.addResource(Resource("Laboratory", 3));
+    system.publish();
+    AccessDaemon daemon(system, socketPath, 2);
+    std::thread loop([&daemon] { daemon.run(); });
+
+    auto connectClient = [&socketPath] {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address = daemonAddress(socketPath);
+        timeval timeout = { 5, 0 };
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to connect to the check daemon");
+        }
+        return fd;
+    };
+    auto sendFrame = [](int fd, uint32_t requestId, DaemonOp op, uint32_t count, const void* payload, size_t size) {
+        DaemonFrame frame = { requestId, static_cast<uint16_t>(op), 0, count };
+        return writeFully(fd, &frame, sizeof(frame)) && writeFully(fd, payload, size);
+    };
+    auto closedByPeer = [](int fd) {
+        char byte;
+        return ::read(fd, &byte, 1) == 0;
+    };
+
+    int fd = connectClient();
+    const std::string name = "Laboratory";
+    DaemonFrame response = {};
+    int32_t handle = -1;
+    sendFrame(fd, 7, DaemonOp::Resolve, static_cast<uint32_t>(name.size()), name.data(), name.size());
+    report.expect(readFully(fd, &response, sizeof(response)) && readFully(fd, &handle, sizeof(handle))
+        && response.requestId == 7 && handle == system.resourceHandle(name), "the daemon resolves a resource name");
+
+    // Three valid batches, a frame with an unknown op, then one more batch that must not be answered
+    std::vector<AccessRequest> batch;
+    for (int i = 0; i < 12; ++i) {
+        batch.push_back(AccessRequest{ i, handle });
+    }
+    batch.push_back(AccessRequest{ 99, handle });
+    for (uint32_t id = 1; id <= 3; ++id) {
+        sendFrame(fd, id, DaemonOp::Check, static_cast<uint32_t>(batch.size()), batch.data(), batch.size() * sizeof(AccessRequest));
+    }
+    sendFrame(fd, 4, static_cast<DaemonOp>(9), 0, nullptr, 0);
+    sendFrame(fd, 5, DaemonOp::Check, static_cast<uint32_t>(batch.size()), batch.data(), batch.size() * sizeof(AccessRequest));
+    std::vector<uint32_t> answered;
+    bool decisionsRight = true;
+    while (readFully(fd, &response, sizeof(response)) && static_cast<DaemonOp>(response.op) == DaemonOp::Check) {
+        std::vector<char> decisions(response.count);
+        readFully(fd, decisions.data(), decisions.size());
+        answered.push_back(response.requestId);
+        decisionsRight = decisionsRight && decisions.size() == batch.size()
+            && static_cast<AccessDecision>(decisions.back()) == AccessDecision::UserNotFound;
+        for (int i = 0; i < 12 && decisionsRight; ++i) {
+            decisionsRight = static_cast<AccessDecision>(decisions[i]) == (i % 6 >= 3 ? AccessDecision::Granted : AccessDecision::Denied);
+        }
+    }
+    std::sort(answered.begin(), answered.end());
+    report.expect(answered == std::vector<uint32_t>{ 1, 2, 3 }, "every batch before a malformed frame is answered, none after it");
+    report.expect(decisionsRight, "the daemon's decisions match the system");
+    report.expect(static_cast<DaemonOp>(response.op) == DaemonOp::Error && response.requestId == 4 && response.count == 0,
+        "a malformed frame is answered with an error frame");
+    report.expect(closedByPeer(fd), "the daemon closes the connection after the error frame");
+    ::close(fd);
+
+    // A frame split across writes, and an empty batch
+    fd = connectClient();
+    std::vector<char> bytes(sizeof(DaemonFrame) + sizeof(AccessRequest));
+    DaemonFrame frame = { 11, static_cast<uint16_t>(DaemonOp::Check), 0, 1 };
+    AccessRequest request = { 5, handle };
+    std::memcpy(bytes.data(), &frame, sizeof(frame));
+    std::memcpy(bytes.data() + sizeof(frame), &request, sizeof(request));
+    for (char byte : bytes) {
+        writeFully(fd, &byte, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    char decision = 0;
+    report.expect(readFully(fd, &response, sizeof(response)) && response.requestId == 11 && response.count == 1
+        && readFully(fd, &decision, 1) && static_cast<AccessDecision>(decision) == AccessDecision::Granted,
+        "a frame that arrives a byte at a time is answered");
+    sendFrame(fd, 12, DaemonOp::Check, 0, nullptr, 0);
+    report.expect(readFully(fd, &response, sizeof(response)) && response.requestId == 12 && response.count == 0,
+        "an empty batch gets an empty answer");
+    ::close(fd);
+
+    // A frame declaring more than the protocol allows is not answered at all
+    fd = connectClient();
+    sendFrame(fd, 13, DaemonOp::Check, kDaemonMaxBatch + 1, nullptr, 0);
+    report.expect(closedByPeer(fd), "an oversized frame closes the connection without a response");
+    ::close(fd);
+
+    daemon.stop();
+    loop.join();
+    ::unlink(socketPath.c_str());
+}
+#endif
+
+// Exported text must quote and escape awkward names exactly, also when records straddle buffer flushes
+void checkExportEscaping(CheckReport& report) {
+    AccessControlSystem<Resource> system;
+    system.addUser<Student>("Plain", 1, 1, "Group 03");
+    system.addUser<Teacher>("Comma, \"Quoted\"", 2, 2, "Line\nBreak");
+    system.addUser<Administrator>("Back\\slash \x01 \xD0\x96", 3, 3, "Tab\there");
+    system.addResource(Resource("Room, \"A\"", 2));
+    SnapshotView snapshot(system.buildSnapshotImage());
+
+    auto exported = [&snapshot](ExportFormat format, bool users, size_t bufferSize) {
+        std::ostringstream out;
+        {
+            SnapshotExporter exporter(out, format, bufferSize);
+            if (users) {
+                exporter.writeUsers(snapshot);
+            }
+            else {
+                exporter.writeResources(snapshot);
+            }
+        }
+        return out.str();
+    };
+
+    const std::string csvUsers = "id,name,accessLevel,type,attribute\n"
+        "1,Plain,1,Student,Group 03\n"
+        "2,\"Comma, \"\"Quoted\"\"\",2,Teacher,\"Line\nBreak\"\n"
+        "3,Back\\slash \x01 \xD0\x96,3,Administrator,Tab\there\n";
+    const std::string jsonUsers =
+        "{\"id\":1,\"name\":\"Plain\",\"accessLevel\":1,\"type\":\"Student\",\"group\":\"Group 03\"}\n"
+        "{\"id\":2,\"name\":\"Comma, \\\"Quoted\\\"\",\"accessLevel\":2,\"type\":\"Teacher\",\"department\":\"Line\\u000aBreak\"}\n"
+        "{\"id\":3,\"name\":\"Back\\\\slash \\u0001 \xD0\x96\",\"accessLevel\":3,\"type\":\"Administrator\",\"position\":\"Tab\\u0009here\"}\n";
+    for (size_t bufferSize : { size_t(64), size_t(1) << 20 }) {
+        std::string size = " (" + std::to_string(bufferSize) + "-byte buffer)";
+        std::string csv = exported(ExportFormat::Csv, true, bufferSize), json = exported(ExportFormat::JsonLines, true, bufferSize);
+        report.expect(csv == csvUsers, "CSV export quotes separators, quotes and line breaks" + size + ":\n" + csv);
+        report.expect(json == jsonUsers, "JSON export escapes quotes, backslashes and control characters" + size + ":\n" + json);
+        report.expect(exported(ExportFormat::Csv, false, bufferSize) == "name,requiredAccessLevel\n\"Room, \"\"A\"\"\",2\n",
+            "CSV resource export quotes names" + size);
+        report.expect(exported(ExportFormat::JsonLines, false, bufferSize) == "{\"name\":\"Room, \\\"A\\\"\",\"requiredAccessLevel\":2}\n",
+            "JSON resource export escapes names" + size);
+    }
+}
+
+int runSelfChecks() {
+    CheckReport report;
+    try {
+        checkGrants(report);
+        checkUserStorage(report);
+        checkSnapshotValidation(report);
+        checkJournalRecovery(report);
+        checkParallelLoader(report);
+        checkTimerWheel(report);
+#ifdef __linux__
+        checkDaemonFrames(report);
+#endif
+        checkExportEscaping(report);
+    }
+    catch (const std::exception& e) {
+        report.expect(false, std::string("unexpected exception: ") + e.what());
+    }
+    std::cout << report.checks << " checks, " << report.failures << " failures" << std::endl;
+    return report.failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "stress") {
+        unsigned readers = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 4;
+        int seconds = argc > 3 ? std::stoi(argv[3]) : 5;
+        return runStressTest(readers, seconds);
+    }
+    if (argc > 2 && std::string(argv[1]) == "audit-decode") {
+        int status = 0;
+        for (int i = 2; i < argc; ++i) {
+            status |= decodeAuditFile(argv[i], std::cout);
+        }
+        return status;
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        // bench [users] [resources] [student %] [teacher %] [lookups]
+        size_t users = argc > 2 ? static_cast<size_t>(std::stoull(argv[2])) : 100000;
+        size_t resources = argc > 3 ? static_cast<size_t>(std::stoull(argv[3])) : 1000;
+        int students = argc > 4 ? std::stoi(argv[4]) : 80;
+        int teachers = argc > 5 ? std::stoi(argv[5]) : 15;
+        size_t lookups = argc > 6 ? static_cast<size_t>(std::stoull(argv[6])) : 1000000;
+        if (users == 0 || resources == 0 || students < 0 || teachers < 0 || students + teachers > 100) {
+            std::cerr << "Usage: bench [users > 0] [resources > 0] [student %] [teacher %] [lookups]" << std::endl;
+            return 1;
+        }
+        return runBenchmark(users, resources, students, teachers, lookups);
+    }
+    if (argc > 1 && std::string(argv[1]) == "export") {
+        // export <csv|jsonl> <users|resources> <data file>, written to stdout
+        std::string format = argc > 2 ? argv[2] : "", what = argc > 3 ? argv[3] : "";
+        if (argc != 5 || (format != "csv" && format != "jsonl") || (what != "users" && what != "resources")) {
+            std::cerr << "Usage: export <csv|jsonl> <users|resources> <data file>" << std::endl;
+            return 1;
+        }
+        try {
+            AccessControlSystem<Resource> system;
+            system.loadFromFileParallel(argv[4]);
+            system.publish();
+            std::ios::sync_with_stdio(false);
+            ExportFormat exportFormat = format == "csv" ? ExportFormat::Csv : ExportFormat::JsonLines;
+            if (what == "users") {
+                system.exportUsers(std::cout, exportFormat);
+            }
+            else {
+                system.exportResources(std::cout, exportFormat);
+            }
+            std::cout.flush();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 2 && (std::string(argv[1]) == "serve" || std::string(argv[1]) == "loadgen")) {
+#ifdef __linux__
+        try {
+            if (std::string(argv[1]) == "serve") {
+                // serve <socket> [workers] [data file]
+                return runDaemon(argv[2], argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 0, argc > 4 ? argv[4] : "");
+            }
+            // loadgen <socket> [connections] [seconds] [batch] [pipeline]
+            return runLoadGenerator(argv[2], argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 4,
+                argc > 4 ? std::stoi(argv[4]) : 5, argc > 5 ? static_cast<unsigned>(std::stoul(argv[5])) : 64,
+                argc > 6 ? static_cast<unsigned>(std::stoul(argv[6])) : 16);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+#else
+        std::cerr << "The access daemon needs Linux (epoll and Unix domain sockets)" << std::endl;
+        return 1;
+#endif
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-shards") {
+        // bench-shards [users] [max shards]
+        size_t users = argc > 2 ? static_cast<size_t>(std::stoull(argv[2])) : 1000000;
+        size_t maxShards = argc > 3 ? static_cast<size_t>(std::stoull(argv[3])) : std::max(1u, std::thread::hardware_concurrency());
+        return runShardBenchmark(std::max<size_t>(users, 1), std::max<size_t>(maxShards, 1));
+    }
+    if (argc > 1 && std::string(argv[1]) == "check") {
+        return runSelfChecks();
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-layout") {
+        return runLayoutBenchmark(argc > 2 ? static_cast<size_t>(std::stoull(argv[2])) : 1000000);
+    }
+
+    try {
+        AccessControlSystem<Resource> system;
+
+        system.addUser<Student>("Shevchenko Nikita", 1, 1, "Group 03");
+        system.addUser<Student>("Kuviko Daniil", 431, 1, "Group 04");
+        system.addUser<Student>("Khara Andrey", 33, 1, "Group 02");
+        system.addUser<Student>("Vorobyova Veronica", 4, 1, "Group 05");
+        system.addUser<Teacher>("Podkolzina Lyubov Alexandrovna", 157, 2, "Institute of Cross-Cutting Technologies");
+        system.addUser<Administrator>("Zhidkova Valeria Yuryevna", 746, 3, "Assistant");
+        system.addUser<Administrator>("Dibrov Alexander Alexandrovich", 107, 4, "Head of the Academic Support Sector");
+        system.addUser<Administrator>("Markarian Yulia Artyomovna", 803, 5, "Director of Institute");
+
+        system.addResource(Resource("Audience 1-384", 1));
+        system.addResource(Resource("Laboratory 202", 3));
+        system.addResource(Resource("Scientific library", 2));
+        system.addResource(Resource("Dean's office", 4));
+        system.addResource(Resource("Director's office", 5));
+
+        std::cout << "All users:\n";
+        system.displayAllUsers();
+
+        std::cout << "\nAll resources:\n";
+        system.displayAllResources();
+
+        std::cout << "\nAccess check:\n";
+        std::cout << system.checkAccess(001, "Audience 1-384") << std::endl;
+        std::cout << system.checkAccess(431, "Laboratory 202") << std::endl;
+        std::cout << system.checkAccess(107, "Scientific library") << std::endl;
         std::cout << system.checkAccess(803, "Director's office") << std::endl;
         std::cout << system.checkAccess(746, "Director's office") << std::endl;
 
+        std::cout << "\nBatch access check:\n";
+        int laboratory = system.resourceHandle("Laboratory 202");
+        std::vector<AccessRequest> requests = { {1, laboratory}, {157, laboratory}, {746, laboratory}, {999, laboratory} };
+        std::vector<AccessDecision> decisions = system.checkAccessBatch(requests);
+        for (size_t i = 0; i < requests.size(); ++i) {
+            std::cout << "User " << requests[i].userId << " -> Laboratory 202: "
+                << accessDecisionName(decisions[i]) << std::endl;
+        }
+
         try {
             system.addUser<Student>("", 4, 1, "Group 102"); // Empty name
         }
@@ -413,6 +5629,59 @@ int main() {
             std::cerr << "Error loading from file: " << e.what() << std::endl;
         }
 
+        system.saveSnapshot("university_access_system.snap");
+        SnapshotView snapshot("university_access_system.snap");
+        std::cout << "\nSnapshot with " << snapshot.userCount() << " users mapped, user 157 -> Laboratory 202: "
+            << (snapshot.decideAccess(157, "Laboratory 202") == AccessDecision::Granted ? "granted" : "denied") << std::endl;
+
+        std::cout << "\nUsers who can access Laboratory 202:";
+        for (int id : system.whoCanAccess("Laboratory 202")) {
+            std::cout << ' ' << id;
+        }
+        std::cout << "\nUsers with access level 2 or higher: " << system.countWithAccess(2) << std::endl;
+
+        system.grantAccess("Laboratory 202", PermissionKind::Group, "Group 03");
+        system.grantAccess("Laboratory 202", PermissionKind::Department, "Institute of Cross-Cutting Technologies");
+        std::cout << "Users who can access Laboratory 202 with Group 03 and department grants:";
+        for (int id : system.whoCanAccess("Laboratory 202")) {
+            std::cout << ' ' << id;
+        }
+        std::cout << std::endl;
+
+        std::cout << "Resources user 157 can access:";
+        for (const Resource* resource : system.accessibleResources(157)) {
+            std::cout << " '" << resource->getName() << "'";
+        }
+        std::cout << "\nResources open to access level 3: " << system.countAccessible(3) << std::endl;
+
+        auto examEnd = std::chrono::system_clock::now() + std::chrono::hours(2);
+        system.grantTemporaryAccess(431, "Dean's office", 4, examEnd);
+        std::cout << system.checkAccess(431, "Dean's office") << " (temporary grant)" << std::endl;
+        system.expireTemporaryGrants(examEnd + std::chrono::seconds(1));
+        std::cout << system.checkAccess(431, "Dean's office") << " (after expiry)" << std::endl;
+
+        system.setPathLevel("Main", 2);
+        system.addResourcePath("Main/3/Laboratory 305");
+        system.addResourcePath("Main/3/Server room", 5);
+        system.setPathLevel("Main/3", 3);
+        std::cout << "Main/3/Laboratory 305 requires level " << system.effectiveLevel("Main/3/Laboratory 305")
+            << ", Main/3/Server room requires level " << system.effectiveLevel("Main/3/Server room") << std::endl;
+        system.addResourcePath("Main/4/Reading room");
+        system.addResourcePath("Main/4", 4);
+        std::cout << system.checkAccess(746, "Main/4/Reading room") << " (floor added after its room)" << std::endl;
+
+        AccessControlSystem<CampusResource> campus;
+        campus.addUser<Student>("Shevchenko Nikita", 1, 1, "Group 03");
+        for (size_t i = 0; i < kCampusRegistry.size(); ++i) {
+            campus.addResource(CampusResource(kCampusRegistry[i].name));
+        }
+        std::cout << "Fixed registry: " << campus.checkAccess(1, "Scientific library") << std::endl;
+
+        std::cout << "\nUsers with access level between 2 and 4:\n";
+        for (User* found : system.findUsersByAccessLevelRange(2, 4)) {
+            found->displayInfo();
+        }
+
         std::cout << "\nSearching for user with ID 33:\n";
         User* user = system.findUserById(33);
         if (user) {
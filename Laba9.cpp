@@ -9,40 +9,1194 @@
 #include <sstream>
 #include <map>
 #include <filesystem>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string_view>
+#include <type_traits>
+#include <cstdint>
+#include <mutex>
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <iterator>
+#include <deque>
+#include <limits>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// localtime_s is MSVC's (C11's has its arguments the other way round), localtime_r is POSIX
+inline bool toLocalTime(std::time_t time, std::tm& result) {
+#ifdef _WIN32
+    return localtime_s(&result, &time) == 0;
+#else
+    return localtime_r(&time, &result) != nullptr;
+#endif
+}
+
+// "[2024-5-17 9:3:7] " as the log has always written it
+inline std::string formatLogTimestamp(std::time_t time) {
+    std::tm ltm = {};
+    toLocalTime(time, ltm);
+    return "[" + std::to_string(1900 + ltm.tm_year) + "-" + std::to_string(1 + ltm.tm_mon) + "-"
+        + std::to_string(ltm.tm_mday) + " " + std::to_string(ltm.tm_hour) + ":"
+        + std::to_string(ltm.tm_min) + ":" + std::to_string(ltm.tm_sec) + "] ";
+}
+
+// Bounded multi-producer single-consumer ring (Vyukov's sequence-numbered cells): a producer claims a
+// cell with one CAS on the tail and publishes it by bumping the cell's sequence; the consumer needs no
+// read-modify-write at all. Cells are reused, so values that keep their capacity (strings) stop allocating.
+template<typename V>
+class MpscQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        V value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    alignas(64) size_t head = 0;
+
+public:
+    explicit MpscQueue(size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("Queue capacity must be a power of two");
+        }
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // fill(value) writes the claimed cell; returns false without calling it if the queue is full
+    template<typename Fill>
+    bool tryPush(Fill fill) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    fill(cell.value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < position) {
+                return false;
+            }
+            else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only: use(value) reads the oldest published value; false if there is none
+    template<typename Use>
+    bool tryPop(Use use) {
+        Cell& cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        use(cell.value);
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    // Values claimed by producers so far, including ones still being written
+    size_t claimed() const { return tail.load(std::memory_order_acquire); }
+};
 
-template<typename T>
+enum class LogMode {
+    Sync,  // every message is formatted and flushed on the calling thread
+    Async  // messages are queued and written in batches by a background thread
+};
+
+enum class OverflowPolicy {
+    Block, // a producer waits for space in the full queue
+    Drop   // the message is discarded and counted; the count is logged once space returns
+};
+
+enum class LogOutput {
+    Text,  // "[time] message" lines
+    Binary // raw records, turned into the same lines offline by decodeBinaryLog
+};
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+enum class LogCategory : uint8_t {
+    General,
+    Battle,
+    Inventory,
+    Save,
+    Count
+};
+
+constexpr uint32_t logCategoryBit(LogCategory category) { return 1u << static_cast<uint32_t>(category); }
+
+const uint32_t kAllLogCategories = (1u << static_cast<uint32_t>(LogCategory::Count)) - 1;
+
+inline const char* logCategoryName(LogCategory category) {
+    switch (category) {
+    case LogCategory::General: return "general";
+    case LogCategory::Battle: return "battle";
+    case LogCategory::Inventory: return "inventory";
+    case LogCategory::Save: return "save";
+    default: return "unknown";
+    }
+}
+
+struct LoggerOptions {
+    LogMode mode = LogMode::Sync;
+    size_t queueCapacity = 1 << 14; // power of two
+    OverflowPolicy overflow = OverflowPolicy::Block;
+    LogOutput output = LogOutput::Text;
+    // Either limit switches to segmented output: numbered files next to the log name, each mapped
+    // into memory at its full size; 0 leaves that limit off
+    size_t segmentBytes = 0;
+    std::chrono::seconds segmentDuration{ 0 };
+    size_t keepSegments = 0; // older segments are deleted; 0 keeps them all
+    size_t indexInterval = 64 << 10; // bytes between entries of a segment's time index; 0 writes no index
+};
+
+const size_t kDefaultLogSegmentBytes = 64 << 20; // segments rotated only by time
+
+// Format strings of the LOG_EVENT call sites, numbered from 1 in registration order
+class LogFormats {
+private:
+    static std::vector<const char*>& table() {
+        static std::vector<const char*> formats;
+        return formats;
+    }
+
+    static std::mutex& mutex() {
+        static std::mutex lock;
+        return lock;
+    }
+
+public:
+    static uint16_t add(const char* format) {
+        std::lock_guard<std::mutex> lock(mutex());
+        if (table().size() >= 0xFFFF) {
+            throw std::runtime_error("Too many log formats");
+        }
+        table().push_back(format);
+        return static_cast<uint16_t>(table().size());
+    }
+
+    // Appends the formats registered since `formats` was last brought up to date; formats are never
+    // removed or renumbered, so a copy stays valid and only needs this on an unknown id
+    static void update(std::vector<const char*>& formats) {
+        std::lock_guard<std::mutex> lock(mutex());
+        formats.insert(formats.end(), table().begin() + static_cast<std::ptrdiff_t>(formats.size()), table().end());
+    }
+};
+
+// Logs a deferred event: the call site's format is registered once, and at run time only the raw bytes
+// of the arguments are copied. Each "{}" in the format is replaced by the next argument when the event
+// is written as text, or when a binary log is decoded.
+// A level or category the logger was not compiled with leaves no code behind, arguments included; an
+// enabled one costs a single comparison against the runtime threshold before anything is evaluated.
+#define LOG_AT(logger, level, category, format, ...) \
+    do { \
+        if constexpr (std::remove_reference_t<decltype(logger)>::compiledIn(level, category)) { \
+            if ((logger).enabled(level)) { \
+                static const uint16_t logEventFormat = LogFormats::add(format); \
+                (logger).event(level, category, logEventFormat, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (false)
+
+#define LOG_DEBUG(logger, category, format, ...) LOG_AT(logger, LogLevel::Debug, category, format, ##__VA_ARGS__)
+#define LOG_INFO(logger, category, format, ...) LOG_AT(logger, LogLevel::Info, category, format, ##__VA_ARGS__)
+#define LOG_WARNING(logger, category, format, ...) LOG_AT(logger, LogLevel::Warning, category, format, ##__VA_ARGS__)
+#define LOG_ERROR(logger, category, format, ...) LOG_AT(logger, LogLevel::Error, category, format, ##__VA_ARGS__)
+#define LOG_EVENT(logger, format, ...) LOG_AT(logger, LogLevel::Info, LogCategory::General, format, ##__VA_ARGS__)
+
+const size_t kLogEventBytes = 192; // encoded arguments of one event; longer strings are cut short
+
+enum class LogArgument : uint8_t {
+    Int = 'i',
+    Unsigned = 'u',
+    Float = 'f',
+    String = 's'
+};
+
+template<typename V>
+void putLogValue(char*& cursor, const V& value) {
+    std::memcpy(cursor, &value, sizeof(value));
+    cursor += sizeof(value);
+}
+
+// Appends one tagged argument; returns false if it does not fit
+template<typename V>
+bool encodeLogArgument(char*& cursor, char* end, const V& value) {
+    if constexpr (std::is_integral_v<V> || std::is_floating_point_v<V>) {
+        if (end - cursor < 9) {
+            return false;
+        }
+        if constexpr (std::is_floating_point_v<V>) {
+            *cursor++ = static_cast<char>(LogArgument::Float);
+            putLogValue(cursor, static_cast<double>(value));
+        }
+        else if constexpr (std::is_signed_v<V>) {
+            *cursor++ = static_cast<char>(LogArgument::Int);
+            putLogValue(cursor, static_cast<int64_t>(value));
+        }
+        else {
+            *cursor++ = static_cast<char>(LogArgument::Unsigned);
+            putLogValue(cursor, static_cast<uint64_t>(value));
+        }
+    }
+    else {
+        std::string_view text(value);
+        if (end - cursor < 3) {
+            return false;
+        }
+        uint16_t length = static_cast<uint16_t>(std::min<size_t>(text.size(), static_cast<size_t>(end - cursor - 3)));
+        *cursor++ = static_cast<char>(LogArgument::String);
+        putLogValue(cursor, length);
+        std::memcpy(cursor, text.data(), length);
+        cursor += length;
+    }
+    return true;
+}
+
+template<typename V>
+V getLogValue(const char*& cursor) {
+    V value;
+    std::memcpy(&value, cursor, sizeof(value));
+    cursor += sizeof(value);
+    return value;
+}
+
+// Replaces each "{}" of format with the next encoded argument; missing arguments stay as "{}". An argument
+// with an unknown tag or running past size (a damaged record read back from a file) ends the text with
+// "<corrupt record>" instead.
+inline void formatLogEvent(std::string& out, std::string_view format, const char* args, size_t size) {
+    const char* cursor = args;
+    const char* end = args + size;
+    size_t pos = 0;
+    while (true) {
+        size_t mark = format.find("{}", pos);
+        out.append(format.substr(pos, mark == std::string_view::npos ? std::string_view::npos : mark - pos));
+        if (mark == std::string_view::npos) {
+            return;
+        }
+        pos = mark + 2;
+
+        if (cursor == end) {
+            out += "{}";
+            continue;
+        }
+        LogArgument kind = static_cast<LogArgument>(*cursor++);
+        size_t left = static_cast<size_t>(end - cursor);
+        size_t needed = kind == LogArgument::String ? sizeof(uint16_t) : sizeof(uint64_t);
+        if (kind == LogArgument::String && left >= needed) {
+            uint16_t length;
+            std::memcpy(&length, cursor, sizeof(length));
+            needed += length;
+        }
+        bool known = kind == LogArgument::Int || kind == LogArgument::Unsigned || kind == LogArgument::Float || kind == LogArgument::String;
+        if (!known || left < needed) {
+            out += "<corrupt record>";
+            return;
+        }
+
+        char number[32];
+        switch (kind) {
+        case LogArgument::Int:
+            out.append(number, std::to_chars(number, number + sizeof(number), getLogValue<int64_t>(cursor)).ptr);
+            break;
+        case LogArgument::Unsigned:
+            out.append(number, std::to_chars(number, number + sizeof(number), getLogValue<uint64_t>(cursor)).ptr);
+            break;
+        case LogArgument::Float:
+            out.append(number, static_cast<size_t>(std::snprintf(number, sizeof(number), "%g", getLogValue<double>(cursor))));
+            break;
+        case LogArgument::String: {
+            uint16_t length = getLogValue<uint16_t>(cursor);
+            out.append(cursor, length);
+            cursor += length;
+            break;
+        }
+        }
+    }
+}
+
+// Binary log: "GLOG", u32 version, then records that each start with a BinaryLogRecord byte
+//   Format:  u16 id, u16 length, format text (written before the first event that uses the id)
+//   Event:   i64 time, u16 format id, u16 size, encoded arguments (older logs only)
+//   Message: i64 time, u32 length, message text
+//   Dropped: i64 time, u64 count
+//   LeveledEvent: i64 time, u8 level, u8 category, u16 format id, u16 size, encoded arguments
+const char kBinaryLogMagic[4] = { 'G', 'L', 'O', 'G' };
+const uint32_t kBinaryLogVersion = 1;
+
+enum class BinaryLogRecord : uint8_t {
+    Format = 1,
+    Event,
+    Message,
+    Dropped,
+    LeveledEvent
+};
+
+template<typename V>
+void appendLogValue(std::string& out, const V& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Time index "<segment>.idx": "GIDX", u32 version, then records that each start with a LogIndexRecord byte
+//   Format: u16 id, u16 length, format text (each format the segment defines, so a reader starting
+//           in the middle of a binary segment can still decode it)
+//   Entry:  i64 time, u64 offset of the record with that time; one per indexInterval bytes of segment
+const char kLogIndexMagic[4] = { 'G', 'I', 'D', 'X' };
+const uint32_t kLogIndexVersion = 1;
+
+enum class LogIndexRecord : uint8_t {
+    Format = 1,
+    Entry
+};
+
+// A log segment: a file pre-allocated to its full capacity and mapped for writing, so appending
+// is a copy and a cursor bump. close() trims the file to what was written.
+class LogSegment {
+private:
+    char* base = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    LogSegment() {}
+    LogSegment(const LogSegment&) = delete;
+    LogSegment& operator=(const LogSegment&) = delete;
+    ~LogSegment() { close(); }
+
+    void open(const std::string& filename, size_t bytes) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Unable to open log segment");
+        }
+        LARGE_INTEGER size;
+        size.QuadPart = static_cast<LONGLONG>(bytes);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+        base = mapping ? static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, bytes)) : nullptr;
+#else
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open log segment");
+        }
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+            void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            base = mapped == MAP_FAILED ? nullptr : static_cast<char*>(mapped);
+        }
+#endif
+        capacity = bytes;
+        used = 0;
+        if (!base) {
+            close();
+            throw std::runtime_error("Unable to map log segment");
+        }
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) {
+            LARGE_INTEGER size;
+            size.QuadPart = static_cast<LONGLONG>(used);
+            SetFilePointerEx(file, size, nullptr, FILE_BEGIN);
+            SetEndOfFile(file);
+            CloseHandle(file);
+        }
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        if (base) munmap(base, capacity);
+        if (fd >= 0) {
+            if (ftruncate(fd, static_cast<off_t>(used)) != 0) {
+                std::cerr << "Unable to trim log segment" << std::endl;
+            }
+            ::close(fd);
+        }
+        fd = -1;
+#endif
+        base = nullptr;
+        capacity = used = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+    size_t room() const { return capacity - used; }
+    size_t size() const { return used; }
+
+    void append(const char* data, size_t bytes) {
+        std::memcpy(base + used, data, bytes);
+        used += bytes;
+    }
+};
+
+// Segment n of "logs/game_log.bin" is "logs/game_log.n.bin"
+inline std::string logSegmentName(const std::string& filename, uint64_t number) {
+    std::filesystem::path path(filename);
+    path.replace_filename(path.stem().string() + "." + std::to_string(number) + path.extension().string());
+    return path.string();
+}
+
+// Existing segments of a log, oldest first
+inline std::vector<std::pair<uint64_t, std::string>> listLogSegments(const std::string& filename) {
+    std::filesystem::path path(filename);
+    std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    std::string prefix = path.stem().string() + ".";
+    std::string extension = path.extension().string();
+
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        std::string name = it->path().filename().string();
+        if (name.size() <= prefix.size() + extension.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+            continue;
+        }
+        std::string_view digits(name.data() + prefix.size(), name.size() - prefix.size() - extension.size());
+        uint64_t number = 0;
+        auto parsed = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+        if (parsed.ec == std::errc() && parsed.ptr == digits.data() + digits.size()) {
+            segments.emplace_back(number, it->path().string());
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// MinLevel and Categories fix at compile time what the LOG_* macros may emit at all;
+// setLevel raises the threshold further at run time
+template<typename T, LogLevel MinLevel = LogLevel::Debug, uint32_t Categories = kAllLogCategories>
 class Logger {
 private:
+    struct Record {
+        std::time_t time = 0;
+        T message{};
+        LogLevel level = LogLevel::Info;
+        LogCategory category = LogCategory::General;
+        uint16_t format = 0; // 0 for a plain message
+        uint16_t size = 0;
+        char args[kLogEventBytes];
+    };
+
     std::ofstream logFile;
+    LoggerOptions options;
+    std::string filename;
+
+    LogSegment segment;
+    uint64_t segmentNumber = 0;
+    std::time_t segmentStart = 0;
+    std::deque<std::string> segments; // oldest first, the open one last
+    std::string pending; // encoded records not yet written to logFile
+    std::string scratch; // the record being placed in a segment
+    std::time_t lastTime = 0; // record times are raised to this, so they never go backwards in the log
+
+    std::ofstream indexFile;
+    std::string indexPending;
+    uint64_t indexedOffset = 0;
+    bool segmentIndexed = false; // the segment has an index entry yet
+
+    std::unique_ptr<MpscQueue<Record>> queue;
+    std::atomic<uint64_t> dropped{ 0 }; // not yet reported in the file
+    std::atomic<uint64_t> droppedTotal{ 0 };
+    std::atomic<size_t> written{ 0 }; // records the writer has handed to the file
+    std::atomic<bool> stopping{ false };
+    std::thread writer;
+    std::atomic<LogLevel> threshold{ MinLevel };
+
+    std::time_t cachedTime = -1;
+    std::string cachedStamp;
+    std::ostringstream formatter;
+    std::vector<bool> formatWritten; // binary output: format ids already defined in this file or segment
+    std::vector<const char*> formats; // the writer's copy of LogFormats, so events need no lock
+
+    const char* formatText(uint16_t id) {
+        if (id > formats.size()) {
+            LogFormats::update(formats);
+        }
+        return id >= 1 && id <= formats.size() ? formats[id - 1] : "";
+    }
+
+    // The timestamp prefix is rebuilt only when the second changes
+    void appendStamp(std::string& out, std::time_t time) {
+        if (time != cachedTime) {
+            cachedTime = time;
+            cachedStamp = formatLogTimestamp(time);
+        }
+        out += cachedStamp;
+    }
+
+    void appendMessage(std::string& out, const T& message) {
+        if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            out += std::string_view(message);
+        }
+        else {
+            formatter.str(std::string());
+            formatter << message;
+            out += formatter.str();
+        }
+    }
+
+    void appendRecord(std::string& out, const Record& record) {
+        if (options.output == LogOutput::Text) {
+            appendStamp(out, record.time);
+            if (record.format) {
+                out += '[';
+                out += logCategoryName(record.category);
+                out += "] ";
+                formatLogEvent(out, formatText(record.format), record.args, record.size);
+            }
+            else {
+                appendMessage(out, record.message);
+            }
+            out += '\n';
+            return;
+        }
+
+        if (!record.format) {
+            size_t start = out.size();
+            out += static_cast<char>(BinaryLogRecord::Message);
+            appendLogValue(out, static_cast<int64_t>(record.time));
+            appendLogValue(out, uint32_t(0));
+            appendMessage(out, record.message);
+            uint32_t length = static_cast<uint32_t>(out.size() - start - 13);
+            std::memcpy(&out[start + 9], &length, sizeof(length));
+            return;
+        }
+        if (record.format >= formatWritten.size()) {
+            formatWritten.resize(record.format + 1, false);
+        }
+        if (!formatWritten[record.format]) {
+            formatWritten[record.format] = true;
+            std::string_view format = formatText(record.format);
+            out += static_cast<char>(BinaryLogRecord::Format);
+            appendLogValue(out, record.format);
+            appendLogValue(out, static_cast<uint16_t>(format.size()));
+            out += format;
+            if (indexFile.is_open()) {
+                indexPending += static_cast<char>(LogIndexRecord::Format);
+                appendLogValue(indexPending, record.format);
+                appendLogValue(indexPending, static_cast<uint16_t>(format.size()));
+                indexPending += format;
+            }
+        }
+        out += static_cast<char>(BinaryLogRecord::LeveledEvent);
+        appendLogValue(out, static_cast<int64_t>(record.time));
+        appendLogValue(out, record.level);
+        appendLogValue(out, record.category);
+        appendLogValue(out, record.format);
+        appendLogValue(out, record.size);
+        out.append(record.args, record.size);
+    }
+
+    void appendDropped(std::string& out, std::time_t now, uint64_t count) {
+        if (options.output == LogOutput::Text) {
+            appendStamp(out, now);
+            out += "(" + std::to_string(count) + " messages dropped)\n";
+            return;
+        }
+        out += static_cast<char>(BinaryLogRecord::Dropped);
+        appendLogValue(out, static_cast<int64_t>(now));
+        appendLogValue(out, count);
+    }
+
+    bool segmented() const { return options.segmentBytes || options.segmentDuration.count(); }
+
+    void writeHeader(std::string& out) {
+        if (options.output == LogOutput::Binary) {
+            out.append(kBinaryLogMagic, sizeof(kBinaryLogMagic));
+            appendLogValue(out, kBinaryLogVersion);
+        }
+    }
+
+    // Starts the next segment, big enough for at least `needed` bytes, and drops the oldest beyond keepSegments
+    void openSegment(std::time_t now, size_t needed) {
+        segment.close();
+        commitIndex();
+        indexFile.close();
+        std::string name = logSegmentName(filename, ++segmentNumber);
+        segment.open(name, std::max(options.segmentBytes ? options.segmentBytes : kDefaultLogSegmentBytes, needed + 64));
+        segmentStart = now;
+        segments.push_back(name);
+        while (options.keepSegments && segments.size() > options.keepSegments) {
+            std::error_code error;
+            std::filesystem::remove(segments.front(), error);
+            std::filesystem::remove(segments.front() + ".idx", error);
+            segments.pop_front();
+        }
+
+        segmentIndexed = false;
+        if (options.indexInterval) {
+            indexFile.open(name + ".idx", std::ios::binary | std::ios::trunc);
+            indexFile.write(kLogIndexMagic, sizeof(kLogIndexMagic));
+            indexFile.write(reinterpret_cast<const char*>(&kLogIndexVersion), sizeof(kLogIndexVersion));
+        }
+
+        formatWritten.clear();
+        scratch.clear();
+        writeHeader(scratch);
+        segment.append(scratch.data(), scratch.size());
+    }
+
+    // Encodes one record into pending bytes, or straight into the current segment
+    template<typename Encode>
+    void emit(std::time_t time, Encode encode) {
+        if (!segmented()) {
+            encode(pending);
+            return;
+        }
+        scratch.clear();
+        encode(scratch);
+        bool expired = options.segmentDuration.count() && time - segmentStart >= options.segmentDuration.count();
+        if (scratch.size() > segment.room() || expired) {
+            openSegment(time, scratch.size());
+            // a binary record may need its format defined again in the new segment
+            scratch.clear();
+            encode(scratch);
+        }
+        if (indexFile.is_open() && (!segmentIndexed || segment.size() - indexedOffset >= options.indexInterval)) {
+            segmentIndexed = true;
+            indexedOffset = segment.size();
+            indexPending += static_cast<char>(LogIndexRecord::Entry);
+            appendLogValue(indexPending, static_cast<int64_t>(time));
+            appendLogValue(indexPending, indexedOffset);
+        }
+        segment.append(scratch.data(), scratch.size());
+    }
+
+    void emitRecord(Record& record) {
+        record.time = lastTime = std::max(record.time, lastTime);
+        emit(record.time, [&](std::string& out) { appendRecord(out, record); });
+    }
+
+    void emitDropped(uint64_t count) {
+        std::time_t now = lastTime = std::max(std::time(nullptr), lastTime);
+        emit(now, [&](std::string& out) { appendDropped(out, now, count); });
+    }
+
+    void commitIndex() {
+        if (!indexPending.empty()) {
+            indexFile.write(indexPending.data(), static_cast<std::streamsize>(indexPending.size()));
+            indexFile.flush();
+            indexPending.clear();
+        }
+    }
+
+    // Hands pending bytes to the file; mapped segments need nothing more, only their index
+    void commit() {
+        if (!pending.empty()) {
+            logFile.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+            logFile.flush();
+            pending.clear();
+        }
+        commitIndex();
+    }
+
+    void writerLoop() {
+        const size_t kBatchBytes = 1 << 20;
+        const size_t kBatchRecords = 1 << 13;
+        pending.reserve(kBatchBytes + 4096);
+        size_t consumed = 0;
+        while (true) {
+            bool stop = stopping.load(std::memory_order_acquire);
+            size_t batched = 0;
+            while (pending.size() < kBatchBytes && batched < kBatchRecords && queue->tryPop([&](Record& record) {
+                emitRecord(record);
+            })) {
+                ++batched;
+            }
+            consumed += batched;
+            uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+            if (lost) {
+                emitDropped(lost);
+            }
+            if (batched || lost) {
+                commit();
+                written.store(consumed, std::memory_order_release);
+                continue;
+            }
+            written.store(consumed, std::memory_order_release);
+            if (stop && consumed == queue->claimed()) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    template<typename Fill>
+    void submit(Fill fill) {
+        if (!queue) {
+            Record record;
+            fill(record);
+            emitRecord(record);
+            commit();
+            return;
+        }
+        while (!queue->tryPush(fill)) {
+            if (options.overflow == OverflowPolicy::Drop) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                droppedTotal.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
 public:
-    Logger(const std::string& filename) {
-        logFile.open(filename, std::ios::app);
-        if (!logFile.is_open()) {
+    Logger(const std::string& filename, LoggerOptions options = LoggerOptions()) : options(options), filename(filename) {
+        if (segmented()) {
+            // numbering continues after the newest segment already on disk
+            for (const auto& existing : listLogSegments(filename)) {
+                segments.push_back(existing.second);
+                segmentNumber = existing.first;
+            }
+            openSegment(std::time(nullptr), 0);
+        }
+        else if (options.output == LogOutput::Binary) {
+            std::error_code error;
+            bool fresh = !std::filesystem::exists(filename, error) || std::filesystem::file_size(filename, error) == 0;
+            logFile.open(filename, std::ios::app | std::ios::binary);
+            if (fresh && logFile.is_open()) {
+                logFile.write(kBinaryLogMagic, sizeof(kBinaryLogMagic));
+                logFile.write(reinterpret_cast<const char*>(&kBinaryLogVersion), sizeof(kBinaryLogVersion));
+            }
+        }
+        else {
+            logFile.open(filename, std::ios::app);
+        }
+        if (!segmented() && !logFile.is_open()) {
             throw std::runtime_error("Unable to open log file");
         }
+        if (options.mode == LogMode::Async) {
+            queue = std::make_unique<MpscQueue<Record>>(options.queueCapacity);
+            writer = std::thread(&Logger::writerLoop, this);
+        }
     }
 
+    // Everything logged before destruction reaches the file
     ~Logger() {
+        if (writer.joinable()) {
+            stopping.store(true, std::memory_order_release);
+            writer.join();
+        }
+        segment.close();
+        commitIndex();
         if (logFile.is_open()) {
             logFile.close();
         }
     }
 
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
     void log(const T& message) {
-        time_t now = time(0);
-        tm ltm;
-        localtime_s(&ltm, &now);
-
-        logFile << "[" << 1900 + ltm.tm_year << "-"
-            << 1 + ltm.tm_mon << "-"
-            << ltm.tm_mday << " "
-            << ltm.tm_hour << ":"
-            << ltm.tm_min << ":"
-            << ltm.tm_sec << "] "
-            << message << std::endl;
+        std::time_t now = std::time(nullptr);
+        submit([&](Record& record) {
+            record.time = now;
+            record.message = message;
+            record.format = 0;
+        });
     }
+
+    static constexpr bool compiledIn(LogLevel level, LogCategory category) {
+        return level >= MinLevel && level < LogLevel::Off && (Categories & logCategoryBit(category)) != 0;
+    }
+
+    bool enabled(LogLevel level) const { return level >= threshold.load(std::memory_order_relaxed); }
+
+    // Levels below MinLevel stay compiled out whatever the threshold
+    void setLevel(LogLevel level) { threshold.store(level, std::memory_order_relaxed); }
+
+    // Use through the LOG_* macros, which supply the call site's format id
+    template<typename... Args>
+    void event(LogLevel level, LogCategory category, uint16_t format, const Args&... args) {
+        std::time_t now = std::time(nullptr);
+        submit([&](Record& record) {
+            record.time = now;
+            record.level = level;
+            record.category = category;
+            record.format = format;
+            char* cursor = record.args;
+            [[maybe_unused]] char* end = record.args + kLogEventBytes;
+            (void)(... && encodeLogArgument(cursor, end, args));
+            record.size = static_cast<uint16_t>(cursor - record.args);
+        });
+    }
+
+    // Blocks until every message logged so far has been written to the file
+    void flush() {
+        if (!queue) {
+            logFile.flush();
+            return;
+        }
+        size_t target = queue->claimed();
+        while (written.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    uint64_t droppedMessages() const { return droppedTotal.load(std::memory_order_relaxed); }
 };
 
+// Sequential reader of a log file from any offset, holding a window of the file in memory
+class LogFileReader {
+private:
+    std::ifstream in;
+    std::vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t position = 0; // file offset of buffer[begin]
+
+public:
+    bool open(const std::string& filename, uint64_t offset) {
+        in.open(filename, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        position = offset;
+        buffer.resize(1 << 20);
+        return in.good();
+    }
+
+    // Makes at least `bytes` bytes readable at data(); false if the file ends first
+    bool need(size_t bytes) {
+        if (end - begin >= bytes) {
+            return true;
+        }
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        if (buffer.size() < bytes) {
+            buffer.resize(bytes);
+        }
+        while (end < bytes && in) {
+            in.read(buffer.data() + end, static_cast<std::streamsize>(buffer.size() - end));
+            end += static_cast<size_t>(in.gcount());
+        }
+        return end >= bytes;
+    }
+
+    const char* data() const { return buffer.data() + begin; }
+    uint64_t offset() const { return position; }
+
+    void skip(size_t bytes) {
+        begin += bytes;
+        position += bytes;
+    }
+
+    // Reads up to the next '\n' (dropped); false at the end of the file
+    bool readLine(std::string& line) {
+        line.clear();
+        while (true) {
+            const char* start = data();
+            const char* newline = static_cast<const char*>(std::memchr(start, '\n', end - begin));
+            if (newline) {
+                line.append(start, newline);
+                skip(static_cast<size_t>(newline - start) + 1);
+                return true;
+            }
+            line.append(start, end - begin);
+            skip(end - begin);
+            if (!need(1)) {
+                return !line.empty();
+            }
+        }
+    }
+};
+
+// Reads binary log records from the reader's position and turns each into its text line;
+// visit(time, category, line) returns false to stop early. Plain messages count as General.
+// Returns false on a corrupt or truncated record.
+template<typename Visit>
+bool readBinaryLogLines(LogFileReader& reader, std::map<uint16_t, std::string>& formats, Visit visit) {
+    std::string line;
+    std::time_t stampTime = -1;
+    std::string stamp;
+    while (reader.need(1)) {
+        BinaryLogRecord kind = static_cast<BinaryLogRecord>(*reader.data());
+        if (*reader.data() == 0) {
+            return true; // unwritten tail of a segment that is still open, or was not closed
+        }
+        size_t head = kind == BinaryLogRecord::Format ? 5 :
+            kind == BinaryLogRecord::Event || kind == BinaryLogRecord::Message ? 13 :
+            kind == BinaryLogRecord::LeveledEvent ? 15 :
+            kind == BinaryLogRecord::Dropped ? 17 : 0;
+        if (!head || !reader.need(head)) {
+            return false;
+        }
+        const char* cursor = reader.data() + head;
+        size_t body = 0;
+        cursor -= kind == BinaryLogRecord::Message ? 4 : 2;
+        if (kind == BinaryLogRecord::Message) {
+            body = getLogValue<uint32_t>(cursor);
+        }
+        else if (kind != BinaryLogRecord::Dropped) {
+            body = getLogValue<uint16_t>(cursor);
+        }
+        if (!reader.need(head + body)) {
+            return false;
+        }
+
+        cursor = reader.data() + 1;
+        std::time_t time = 0;
+        LogCategory category = LogCategory::General;
+        if (kind == BinaryLogRecord::Format) {
+            uint16_t id = getLogValue<uint16_t>(cursor);
+            formats[id].assign(cursor + 2, body);
+            reader.skip(head + body);
+            continue;
+        }
+        time = static_cast<std::time_t>(getLogValue<int64_t>(cursor));
+        if (time != stampTime) {
+            stampTime = time;
+            stamp = formatLogTimestamp(time);
+        }
+        line = stamp;
+        if (kind == BinaryLogRecord::Event || kind == BinaryLogRecord::LeveledEvent) {
+            if (kind == BinaryLogRecord::LeveledEvent) {
+                getLogValue<LogLevel>(cursor);
+                category = getLogValue<LogCategory>(cursor);
+                line += '[';
+                line += logCategoryName(category);
+                line += "] ";
+            }
+            uint16_t format = getLogValue<uint16_t>(cursor);
+            formatLogEvent(line, formats[format], cursor + 2, body);
+        }
+        else if (kind == BinaryLogRecord::Message) {
+            line.append(cursor + 4, body);
+        }
+        else {
+            line += "(" + std::to_string(getLogValue<uint64_t>(cursor)) + " messages dropped)";
+        }
+        reader.skip(head + body);
+        if (!visit(time, category, line)) {
+            return true;
+        }
+    }
+    return true;
+}
+
+// Turns a binary log back into the text lines the logger would have written
+inline int decodeBinaryLog(const std::string& filename, std::ostream& out) {
+    LogFileReader reader;
+    if (!reader.open(filename, 0) || !reader.need(8) || std::memcmp(reader.data(), kBinaryLogMagic, sizeof(kBinaryLogMagic)) != 0) {
+        std::cerr << filename << ": not a binary log" << std::endl;
+        return 1;
+    }
+    reader.skip(8);
+
+    std::map<uint16_t, std::string> formats;
+    bool complete = readBinaryLogLines(reader, formats, [&](std::time_t, LogCategory, const std::string& line) {
+        out << line << '\n';
+        return true;
+    });
+    if (!complete) {
+        std::cerr << filename << ": corrupt or truncated record at offset " << reader.offset() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Time index of a log segment, read from "<segment>.idx"
+struct LogIndex {
+    std::vector<std::pair<std::time_t, uint64_t>> entries; // time of the record starting at each offset
+    std::map<uint16_t, std::string> formats;
+};
+
+inline bool readLogIndex(const std::string& segmentName, LogIndex& index) {
+    std::ifstream in(segmentName + ".idx", std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 8 || std::memcmp(data.data(), kLogIndexMagic, sizeof(kLogIndexMagic)) != 0) {
+        return false;
+    }
+    const char* cursor = data.data() + 8;
+    const char* end = data.data() + data.size();
+    while (end - cursor >= 5) {
+        LogIndexRecord kind = static_cast<LogIndexRecord>(*cursor++);
+        if (kind == LogIndexRecord::Entry && end - cursor >= 16) {
+            std::time_t time = static_cast<std::time_t>(getLogValue<int64_t>(cursor));
+            index.entries.emplace_back(time, getLogValue<uint64_t>(cursor));
+        }
+        else if (kind == LogIndexRecord::Format) {
+            uint16_t id = getLogValue<uint16_t>(cursor);
+            uint16_t length = getLogValue<uint16_t>(cursor);
+            if (end - cursor < length) {
+                break;
+            }
+            index.formats[id].assign(cursor, length);
+            cursor += length;
+        }
+        else {
+            break; // a partly written tail
+        }
+    }
+    return true;
+}
+
+// Parses "2024-5-17 9:03:07" (also with 'T' in the middle) as local time, or plain seconds since the epoch
+inline bool parseLogTime(const std::string& text, std::time_t& time) {
+    std::tm parts{};
+    char separator = 0;
+    if (std::sscanf(text.c_str(), "%d-%d-%d%c%d:%d:%d", &parts.tm_year, &parts.tm_mon, &parts.tm_mday, &separator,
+        &parts.tm_hour, &parts.tm_min, &parts.tm_sec) == 7 && (separator == ' ' || separator == 'T')) {
+        parts.tm_year -= 1900;
+        parts.tm_mon -= 1;
+        parts.tm_isdst = -1;
+        time = std::mktime(&parts);
+        return time != -1;
+    }
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), time);
+    return parsed.ec == std::errc() && parsed.ptr == text.data() + text.size();
+}
+
+// Time and category of text log lines "[time] [category] message"; the time is parsed again only
+// when the stamp changes
+class LogLineParser {
+private:
+    std::string stamp;
+    std::time_t stampTime = 0;
+
+public:
+    bool parse(const std::string& line, std::time_t& time, LogCategory& category) {
+        size_t close = line.find("] ");
+        if (line.empty() || line[0] != '[' || close == std::string::npos) {
+            return false;
+        }
+        if (line.compare(1, close - 1, stamp) != 0) {
+            stamp = line.substr(1, close - 1);
+            if (!parseLogTime(stamp, stampTime)) {
+                stamp.clear();
+                return false;
+            }
+        }
+        time = stampTime;
+
+        category = LogCategory::General;
+        size_t tagEnd = line.find("] ", close + 2);
+        if (close + 2 < line.size() && line[close + 2] == '[' && tagEnd != std::string::npos) {
+            std::string_view tag(line.data() + close + 3, tagEnd - close - 3);
+            for (uint8_t i = 0; i < static_cast<uint8_t>(LogCategory::Count); ++i) {
+                if (tag == logCategoryName(static_cast<LogCategory>(i))) {
+                    category = static_cast<LogCategory>(i);
+                }
+            }
+        }
+        return true;
+    }
+};
+
+struct LogQuery {
+    std::time_t from = std::numeric_limits<std::time_t>::min();
+    std::time_t to = std::numeric_limits<std::time_t>::max();
+    std::string contains; // empty matches every line
+    bool anyCategory = true;
+    LogCategory category = LogCategory::General;
+};
+
+// Prints the lines of a log (one file, or the segments of a rotated log) within [from, to] that match
+// the filters. Timestamps never go backwards in a segment, so the time index of each segment gives the
+// offset to start from, whole segments before the window are skipped, and reading stops past its end.
+inline int queryLog(const std::string& filename, const LogQuery& query, std::ostream& out) {
+    std::vector<std::string> files;
+    for (const auto& segment : listLogSegments(filename)) {
+        files.push_back(segment.second);
+    }
+    if (files.empty() && std::filesystem::exists(filename)) {
+        files.push_back(filename);
+    }
+    if (files.empty()) {
+        std::cerr << "No log found at " << filename << std::endl;
+        return 1;
+    }
+
+    std::vector<LogIndex> indexes(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        readLogIndex(files[i], indexes[i]);
+    }
+
+    bool past = false;
+    for (size_t i = 0; i < files.size() && !past; ++i) {
+        const LogIndex& index = indexes[i];
+        if (i + 1 < files.size() && !indexes[i + 1].entries.empty() && indexes[i + 1].entries.front().first < query.from) {
+            continue; // the next segment already starts before the window
+        }
+        if (!index.entries.empty() && index.entries.front().first > query.to) {
+            break;
+        }
+
+        LogFileReader probe;
+        bool binary = probe.open(files[i], 0) && probe.need(8) && std::memcmp(probe.data(), kBinaryLogMagic, sizeof(kBinaryLogMagic)) == 0;
+        uint64_t start = binary ? 8 : 0;
+        auto entry = std::lower_bound(index.entries.begin(), index.entries.end(), query.from,
+            [](const std::pair<std::time_t, uint64_t>& e, std::time_t time) { return e.first < time; });
+        if (entry != index.entries.begin()) {
+            start = std::prev(entry)->second;
+        }
+        LogFileReader reader;
+        reader.open(files[i], start);
+
+        auto visit = [&](std::time_t time, LogCategory category, const std::string& line) {
+            if (time > query.to) {
+                past = true;
+                return false;
+            }
+            if (time >= query.from && (query.anyCategory || category == query.category) &&
+                (query.contains.empty() || line.find(query.contains) != std::string::npos)) {
+                out << line << '\n';
+            }
+            return true;
+        };
+        if (binary) {
+            std::map<uint16_t, std::string> formats = index.formats;
+            if (!readBinaryLogLines(reader, formats, visit)) {
+                std::cerr << files[i] << ": corrupt or truncated record at offset " << reader.offset() << std::endl;
+                return 1;
+            }
+        }
+        else {
+            LogLineParser parser;
+            std::string line;
+            std::time_t time;
+            LogCategory category;
+            // A segment that was not closed is zero-filled from its write offset on, and no text line holds a NUL
+            while (reader.readLine(line) && (line.empty() || line[0] != '\0')) {
+                if (!line.empty() && parser.parse(line, time, category) && !visit(time, category, line)) {
+                    break;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 class Item {
 protected:
     std::string name;
@@ -65,7 +1219,7 @@ public:
         std::getline(iss, name);
     }
 
-    std::string getName() const { return name; }
+    const std::string& getName() const { return name; }
 };
 
 class Weapon : public Item {
@@ -245,7 +1399,7 @@ public:
             << ", Attack: " << attack << ", Defense: " << defense << std::endl;
     }
 
-    std::string getName() const { return name; }
+    const std::string& getName() const { return name; }
     int getHealth() const { return health; }
     int getMaxHealth() const { return maxHealth; }
     int getAttack() const { return attack; }
@@ -402,10 +1556,24 @@ public:
     int getExperienceReward() const override { return 10; }
 };
 
+// Levels below this are compiled out of the game, e.g. -DGAME_LOG_MIN_LEVEL=LogLevel::Warning
+#ifndef GAME_LOG_MIN_LEVEL
+#define GAME_LOG_MIN_LEVEL LogLevel::Debug
+#endif
+
+inline LoggerOptions gameLogOptions() {
+    LoggerOptions options;
+    options.mode = LogMode::Async;
+    options.output = LogOutput::Binary;
+    options.segmentBytes = 16 << 20;
+    options.keepSegments = 8;
+    return options;
+}
+
 class Game {
 private:
     std::unique_ptr<Character> player;
-    Logger<std::string> logger;
+    Logger<std::string, GAME_LOG_MIN_LEVEL> logger;
     bool gameRunning;
 
     void saveGame() {
@@ -417,7 +1585,7 @@ private:
         saveFile << player->serialize();
         saveFile.close();
         std::cout << "Game saved successfully!" << std::endl;
-        logger.log("Game saved");
+        LOG_INFO(logger, LogCategory::Save, "Game saved");
     }
 
     void loadGame() {
@@ -431,13 +1599,13 @@ private:
         saveFile.close();
 
         std::cout << "Game loaded successfully!" << std::endl;
-        logger.log("Game loaded");
+        LOG_INFO(logger, LogCategory::Save, "Game loaded");
     }
 
     void deleteProgress() {
         if (std::remove("savegame.txt") == 0) {
             std::cout << "Progress deleted successfully!" << std::endl;
-            logger.log("Game progress deleted");
+            LOG_WARNING(logger, LogCategory::Save, "Game progress deleted");
         }
         else {
             std::cout << "No save file found to delete or error occurred." << std::endl;
@@ -455,7 +1623,7 @@ private:
         player->addToInventory(std::make_shared<HealthPotion>("Health Potion", 20));
 
         std::cout << "Character created successfully!" << std::endl;
-        logger.log("New character created: " + name);
+        LOG_INFO(logger, LogCategory::General, "New character created: {}", name);
     }
 
     void battle() {
@@ -469,7 +1637,7 @@ private:
         }
 
         std::cout << "A wild " << monster->getName() << " appears!" << std::endl;
-        logger.log("Battle started with " + monster->getName());
+        LOG_INFO(logger, LogCategory::Battle, "Battle started with {}", monster->getName());
 
         while (player->isAlive() && monster->isAlive()) {
             std::cout << "\nYour turn:" << std::endl;
@@ -485,7 +1653,7 @@ private:
                 switch (choice) {
                 case 1: {
                     player->attackTarget(*monster);
-                    logger.log(player->getName() + " attacks " + monster->getName());
+                    LOG_DEBUG(logger, LogCategory::Battle, "{} attacks {}", player->getName(), monster->getName());
                     break;
                 }
                 case 2: {
@@ -502,18 +1670,18 @@ private:
                     std::getline(std::cin, itemName);
 
                     player->useItem(itemName);
-                    logger.log(player->getName() + " used item: " + itemName);
+                    LOG_INFO(logger, LogCategory::Inventory, "{} used item: {}", player->getName(), itemName);
                     continue;
                 }
                 case 3: {
                     if (rand() % 100 < 30) {
                         std::cout << "You successfully fled from battle!" << std::endl;
-                        logger.log(player->getName() + " fled from battle");
+                        LOG_INFO(logger, LogCategory::Battle, "{} fled from battle", player->getName());
                         return;
                     }
                     else {
                         std::cout << "You failed to flee!" << std::endl;
-                        logger.log(player->getName() + " failed to flee");
+                        LOG_DEBUG(logger, LogCategory::Battle, "{} failed to flee", player->getName());
                     }
                     break;
                 default:
@@ -530,25 +1698,25 @@ private:
             if (monster->isAlive()) {
                 std::cout << "\nEnemy's turn:" << std::endl;
                 monster->attackTarget(*player);
-                logger.log(monster->getName() + " attacks " + player->getName());
+                LOG_DEBUG(logger, LogCategory::Battle, "{} attacks {}", monster->getName(), player->getName());
             }
         }
 
         if (!player->isAlive()) {
             std::cout << "You were defeated by the " << monster->getName() << "!" << std::endl;
-            logger.log(player->getName() + " was defeated by " + monster->getName());
+            LOG_WARNING(logger, LogCategory::Battle, "{} was defeated by {}", player->getName(), monster->getName());
             gameRunning = false;
         }
         else {
             std::cout << "You defeated the " << monster->getName() << "!" << std::endl;
             int exp = monster->getExperienceReward();
             player->gainExperience(exp);
-            logger.log(player->getName() + " defeated " + monster->getName() + " and gained " + std::to_string(exp) + " XP");
+            LOG_INFO(logger, LogCategory::Battle, "{} defeated {} and gained {} XP", player->getName(), monster->getName(), exp);
 
             // Восстановление здоровья после боя (5-25 HP)
             int healAmount = 5 + rand() % 21; // 5-25 случайное число
             player->heal(healAmount);
-            logger.log(player->getName() + " recovered " + std::to_string(healAmount) + " HP after battle");
+            LOG_DEBUG(logger, LogCategory::Battle, "{} recovered {} HP after battle", player->getName(), healAmount);
         }
     }
 
@@ -643,7 +1811,9 @@ private:
     }
 
 public:
-    Game() : logger("game_log.txt"), gameRunning(false) {
+    // Binary log in segments game_log.1.bin, game_log.2.bin, ...;
+    // "decode game_log.bin game_log.txt" turns them into the readable log
+    Game() : logger("game_log.bin", gameLogOptions()), gameRunning(false) {
         srand(time(0));
     }
 
@@ -653,7 +1823,241 @@ public:
     }
 };
 
-int main() {
+// Per-call cost of a debug event that is compiled out, switched off at run time, and written
+inline void runLogBenchmark(size_t iterations) {
+    const char* file = "bench_log.bin";
+    LoggerOptions options{ LogMode::Async, 1 << 14, OverflowPolicy::Block, LogOutput::Binary };
+    std::string name = "Hero";
+    volatile uint64_t sink = 0;
+
+    auto measure = [&](const char* label, size_t count, auto&& body) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            sink = sink + i;
+            body(i);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << label << ": " << ns / count << " ns per call" << std::endl;
+    };
+
+    measure("loop only", iterations, [](size_t) {});
+    {
+        Logger<std::string, LogLevel::Warning> quiet(file, options);
+        measure("compiled out", iterations, [&](size_t i) {
+            LOG_DEBUG(quiet, LogCategory::Battle, "{} step {}", std::to_string(i), i);
+        });
+    }
+    {
+        Logger<std::string> runtime(file, options);
+        runtime.setLevel(LogLevel::Warning);
+        measure("below runtime threshold", iterations, [&](size_t i) {
+            LOG_DEBUG(runtime, LogCategory::Battle, "{} step {}", std::to_string(i), i);
+        });
+        runtime.setLevel(LogLevel::Debug);
+        // one pass over the whole queue first, then a run short enough that the writer does not throttle it
+        for (size_t i = 0; i < options.queueCapacity; ++i) {
+            LOG_DEBUG(runtime, LogCategory::Battle, "{} step {}", name, i);
+        }
+        runtime.flush();
+        measure("enabled", options.queueCapacity / 2, [&](size_t i) {
+            LOG_DEBUG(runtime, LogCategory::Battle, "{} step {}", name, i);
+        });
+    }
+    std::error_code error;
+    std::filesystem::remove(file, error);
+}
+
+// Every segment of a rotated log given by its base name, or the single file of that name if it has none
+inline int decodeLogFiles(const std::string& filename, std::ostream& out) {
+    auto segments = listLogSegments(filename);
+    if (segments.empty()) {
+        if (std::filesystem::exists(filename)) {
+            return decodeBinaryLog(filename, out);
+        }
+        std::cerr << "No log found at " << filename << std::endl;
+        return 1;
+    }
+    int status = 0;
+    for (const auto& segment : segments) {
+        status |= decodeBinaryLog(segment.second, out);
+    }
+    return status;
+}
+
+// Removes a log and its segments with their time indexes
+inline void removeLogFiles(const std::string& filename) {
+    std::error_code error;
+    for (const auto& segment : listLogSegments(filename)) {
+        std::filesystem::remove(segment.second, error);
+        std::filesystem::remove(segment.second + ".idx", error);
+    }
+    std::filesystem::remove(filename, error);
+}
+
+// Writes text and binary logs over four seconds in small indexed segments, then checks that queryLog
+// returns for each time window exactly the lines a full scan filtered by time gives, and in order
+inline int runLogChecks() {
+    int checks = 0, failures = 0;
+    auto expect = [&](bool ok, const std::string& what) {
+        ++checks;
+        if (!ok) {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+    };
+    auto query = [](const std::string& filename, const LogQuery& query) {
+        std::ostringstream out;
+        int status = queryLog(filename, query, out);
+        std::vector<std::string> lines;
+        std::istringstream in(out.str());
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line);
+        }
+        return std::make_pair(status, lines);
+    };
+
+    const int kPhases = 4, kLinesPerPhase = 150;
+    for (LogOutput output : { LogOutput::Text, LogOutput::Binary }) {
+        const std::string filename = output == LogOutput::Text ? "check_log.txt" : "check_log.bin";
+        const std::string label = output == LogOutput::Text ? "text log: " : "binary log: ";
+        removeLogFiles(filename);
+        LoggerOptions options;
+        options.output = output;
+        options.segmentBytes = 4096;
+        options.indexInterval = 256;
+        {
+            Logger<std::string> logger(filename, options);
+            for (int phase = 0; phase < kPhases; ++phase) {
+                for (int i = 0; i < kLinesPerPhase; ++i) {
+                    if (i % 2) {
+                        LOG_INFO(logger, LogCategory::Battle, "phase {} line {}", phase, i);
+                    }
+                    else {
+                        LOG_INFO(logger, LogCategory::General, "phase {} line {}", phase, i);
+                    }
+                }
+                if (phase + 1 < kPhases) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+                }
+            }
+        }
+
+        auto all = query(filename, LogQuery());
+        expect(all.first == 0, label + "an unbounded query succeeds");
+        expect(listLogSegments(filename).size() > 4, label + "the log was split into segments");
+        bool inOrder = all.second.size() == static_cast<size_t>(kPhases * kLinesPerPhase);
+        std::vector<std::time_t> times;
+        LogLineParser parser;
+        for (size_t i = 0; inOrder && i < all.second.size(); ++i) {
+            const std::string& line = all.second[i];
+            std::string message = "phase " + std::to_string(i / kLinesPerPhase) + " line " + std::to_string(i % kLinesPerPhase);
+            std::time_t time;
+            LogCategory category;
+            inOrder = parser.parse(line, time, category) && line.size() >= message.size()
+                && line.compare(line.size() - message.size(), message.size(), message) == 0 && (times.empty() || time >= times.back());
+            times.push_back(time);
+        }
+        expect(inOrder, label + "an unbounded query returns every line in order");
+        if (!inOrder) {
+            continue;
+        }
+
+        // Every window between and around the seconds that occur, each compared with a filtered full scan
+        std::vector<std::time_t> bounds(times.begin(), times.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        bounds.insert(bounds.begin(), bounds.front() - 1);
+        bounds.push_back(bounds.back() + 1);
+        size_t windows = 0, wrong = 0;
+        for (std::time_t from : bounds) {
+            for (std::time_t to : bounds) {
+                LogQuery window;
+                window.from = from;
+                window.to = to;
+                std::vector<std::string> expected;
+                for (size_t i = 0; i < times.size(); ++i) {
+                    if (times[i] >= from && times[i] <= to) {
+                        expected.push_back(all.second[i]);
+                    }
+                }
+                auto found = query(filename, window);
+                ++windows;
+                if (found.first != 0 || found.second != expected) {
+                    ++wrong;
+                    std::cerr << label << "window [" << from << ", " << to << "] returned " << found.second.size()
+                        << " lines, expected " << expected.size() << std::endl;
+                }
+            }
+        }
+        expect(wrong == 0, label + std::to_string(wrong) + " of " + std::to_string(windows) + " time windows differ from a full scan");
+
+        LogQuery filtered;
+        filtered.from = bounds[2];
+        filtered.anyCategory = false;
+        filtered.category = LogCategory::Battle;
+        filtered.contains = "line 1";
+        size_t expected = 0;
+        for (size_t i = 0; i < times.size(); ++i) {
+            expected += times[i] >= filtered.from && i % 2 == 1 && all.second[i].find("line 1") != std::string::npos;
+        }
+        auto found = query(filename, filtered);
+        expect(found.first == 0 && found.second.size() == expected, label + "category and text filters apply within the window");
+        removeLogFiles(filename);
+    }
+    std::cout << checks << " checks, " << failures << " failures" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 2 && std::string(argv[1]) == "decode") {
+        // decode <binary log or rotated log name> [text output]
+        if (argc > 3) {
+            std::ofstream out(argv[3], std::ios::app);
+            if (!out.is_open()) {
+                std::cerr << "Unable to open " << argv[3] << std::endl;
+                return 1;
+            }
+            return decodeLogFiles(argv[2], out);
+        }
+        return decodeLogFiles(argv[2], std::cout);
+    }
+    if (argc > 4 && std::string(argv[1]) == "query") {
+        // query <log> <from> <to> [--contains text] [--category name]
+        LogQuery query;
+        if (!parseLogTime(argv[3], query.from) || !parseLogTime(argv[4], query.to)) {
+            std::cerr << "Times are \"Y-M-D H:M:S\" or seconds since the epoch" << std::endl;
+            return 1;
+        }
+        for (int i = 5; i + 1 < argc; i += 2) {
+            std::string option = argv[i];
+            if (option == "--contains") {
+                query.contains = argv[i + 1];
+                continue;
+            }
+            bool known = false;
+            for (uint8_t c = 0; option == "--category" && c < static_cast<uint8_t>(LogCategory::Count); ++c) {
+                if (logCategoryName(static_cast<LogCategory>(c)) == std::string(argv[i + 1])) {
+                    query.anyCategory = false;
+                    query.category = static_cast<LogCategory>(c);
+                    known = true;
+                }
+            }
+            if (!known) {
+                std::cerr << "Unknown option " << option << " " << argv[i + 1] << std::endl;
+                return 1;
+            }
+        }
+        return queryLog(argv[2], query, std::cout);
+    }
+    if (argc > 1 && std::string(argv[1]) == "check") {
+        // check: writes and queries logs in the working directory, exits non-zero on a failure
+        return runLogChecks();
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-log") {
+        // bench-log [iterations]
+        runLogBenchmark(argc > 2 ? std::stoul(argv[2]) : 1 << 24);
+        return 0;
+    }
+
     try {
         Game game;
         game.start();